@@ -42,9 +42,21 @@ POSSIBILITY OF SUCH DAMAGE.
 ************************************************************************/
 
 #include <stdio.h>
+#include <stdarg.h>
+#include <ctype.h>
 #include <string.h>
 #include <algorithm>
 #include "diagtask.hpp"
+#if defined(__ARM_FEATURE_CRC32)
+  #include <arm_acle.h>
+#endif
+#if DIAGTASK_HOOK_KEY_LEN && !DIAGTASK_NAME_POOL_LEN
+  #if defined(__SSE2__)
+    #include <emmintrin.h>
+  #elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+  #endif
+#endif
 
 #define ENABLE_ECHO 1
 
@@ -60,38 +72,415 @@ POSSIBILITY OF SUCH DAMAGE.
 #define SPECIAL_KEYWORD_WILDCARD    '*'
 /// @}
 
+#define FRAME_SYNC                0xA5
+
+#if DIAGTASK_ENABLE_TRIGGERS
+/// @cond
+// byte code of trigger conditions
+enum triggerOp_t
+{
+  op_End,
+  op_Const8,    // followed by int8_t
+  op_Const32,   // followed by int32_t
+  op_Var,       // followed by index into mVariables
+  op_Or,        // binary operators in order of precedence
+  op_And,
+  op_Eq,
+  op_Ne,
+  op_Lt,
+  op_Le,
+  op_Gt,
+  op_Ge,
+  op_Add,
+  op_Sub,
+  op_Not,       // unary operators
+  op_Neg
+};
+
+// binary operators; level is the precedence used by privParseExpr()
+struct triggerOperator_t
+{
+  char    text[3];
+  uint8_t op;
+  uint8_t level;
+};
+/// @endcond
+
+// longer operators first ("<=" before "<")
+static const triggerOperator_t triggerOperators[] =
+{
+  { "||", op_Or,  0 },
+  { "&&", op_And, 1 },
+  { "==", op_Eq,  2 },
+  { "!=", op_Ne,  2 },
+  { "<=", op_Le,  2 },
+  { ">=", op_Ge,  2 },
+  { "<",  op_Lt,  2 },
+  { ">",  op_Gt,  2 },
+  { "+",  op_Add, 3 },
+  { "-",  op_Sub, 3 }
+};
+
+#define TRIGGER_LEVELS  4   // number of precedence levels of binary operators
+#endif // DIAGTASK_ENABLE_TRIGGERS
+
+/// @defgroup stream_frames Frame types of binary stream
+/// @{
+#define STREAM_FRAME_KEY          0
+#define STREAM_FRAME_DELTA        1
+#define STREAM_FRAME_DESCRIPTION  2
+#define STREAM_FRAME_CAPTURE      3   // count, trigger position, period, ticks per second
+#define STREAM_FRAME_MEMORY       4   // 64 bit address, data
+#define STREAM_FRAME_UPLOAD       5   // from host: data block, crc-32 instead of crc-8
+#define STREAM_FRAME_UPLOAD_END   6   // from host: size, crc-32 of upload; no payload cancels
+#define STREAM_FRAME_UPLOAD_ACK   7   // status, offset
+#define STREAM_FRAME_DOWNLOAD     8   // offset, data
+#define STREAM_FRAME_DOWNLOAD_END 9   // size, crc-32
+#define STREAM_FRAME_COMPRESS     10  // window bits; following output is compressed
+/// @}
+
+#if DIAGTASK_ENABLE_UPLOAD
+/// @cond
+// status of STREAM_FRAME_UPLOAD_ACK
+enum uploadStatus_t
+{
+  upload_Ready,   // offset is maximal block length
+  upload_Ack,     // all blocks before sequence were written
+  upload_Nak,     // send again starting with sequence
+  upload_Done,
+  upload_Failed
+};
+/// @endcond
+#endif // DIAGTASK_ENABLE_UPLOAD
+
+#define KEY_ESC                   27
+
+#if DIAGTASK_ENABLE_COMPRESSION
+/// @cond
+// lzss: a flag byte (bit 0 first) tells if each of the following 8 tokens is a literal
+// byte or a match. A match is a 16 bit big endian value: (distance - 1) << ZIP_LEN_BITS | code.
+// code 0 is a control token; distance then selects zip_Flush or zip_End.
+#define ZIP_LEN_BITS      (16 - DIAGTASK_COMPRESS_WINDOW_BITS)
+#define ZIP_MIN_MATCH     3
+#define ZIP_MAX_MATCH     ((1 << ZIP_LEN_BITS) - 1 + ZIP_MIN_MATCH - 1)
+#define ZIP_WINDOW_MASK   ((1 << DIAGTASK_COMPRESS_WINDOW_BITS) - 1)
+
+enum zipControl_t
+{
+  zip_Flush,    // rest of group is empty
+  zip_End       // output is not compressed anymore
+};
+/// @endcond
+#endif // DIAGTASK_ENABLE_COMPRESSION
+
+#if DIAGTASK_ENABLE_MEMORY
+// two hex digits per byte value
+#define HEX_PAIRS(x)  #x "0" #x "1" #x "2" #x "3" #x "4" #x "5" #x "6" #x "7" \
+                      #x "8" #x "9" #x "a" #x "b" #x "c" #x "d" #x "e" #x "f"
+static const char hexPairs[] = HEX_PAIRS(0) HEX_PAIRS(1) HEX_PAIRS(2) HEX_PAIRS(3)
+                               HEX_PAIRS(4) HEX_PAIRS(5) HEX_PAIRS(6) HEX_PAIRS(7)
+                               HEX_PAIRS(8) HEX_PAIRS(9) HEX_PAIRS(a) HEX_PAIRS(b)
+                               HEX_PAIRS(c) HEX_PAIRS(d) HEX_PAIRS(e) HEX_PAIRS(f);
+
+#endif // DIAGTASK_ENABLE_MEMORY
+
+#if (DIAGTASK_ENABLE_MEMORY || DIAGTASK_ENABLE_UPLOAD || DIAGTASK_ENABLE_DOWNLOAD) && !defined(__ARM_FEATURE_CRC32)
+  #if DIAGTASK_CRC32_SLICE_BY_8
+    // generated at first use
+    static uint32_t crc32Table[8][256];
+  #else
+    static const uint32_t crc32Nibbles[16] =
+    {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+      0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+  #endif
+#endif // (DIAGTASK_ENABLE_MEMORY || DIAGTASK_ENABLE_UPLOAD || DIAGTASK_ENABLE_DOWNLOAD) && !defined(__ARM_FEATURE_CRC32)
+
 // --- local types
+#if DIAGTASK_ENABLE_TRACE
+/// @cond
+enum traceType_t
+{
+  trace_Free,
+  trace_Boot,
+  trace_Command,  // special character
+  trace_Hook,     // data: hook function, arg: argument length
+  trace_Log,      // data: format string, arg: log level
+  trace_Reboot
+};
+
+struct traceEntry_t
+{
+  uint32_t  time;
+  uintptr_t data;
+  uint16_t  arg;
+  uint8_t   type;
+  uint8_t   boot;   // lower bits of boot counter
+};
+
+struct traceBuffer_t
+{
+  uint32_t              magic;
+  uint32_t              boot;
+  uint32_t              image;      // id of image that wrote the buffer last
+  uint32_t              imageBoot;  // first boot of this image
+  std::atomic<uint32_t> index;  // next write position
+  traceEntry_t          entries[DIAGTASK_TRACE_ENTRIES];
+};
+/// @endcond
+
+#define TRACE_MAGIC 0x44545232 // "DTR2"
+
+static_assert((DIAGTASK_TRACE_ENTRIES & (DIAGTASK_TRACE_ENTRIES - 1)) == 0,
+              "DIAGTASK_TRACE_ENTRIES must be a power of two");
+#endif // DIAGTASK_ENABLE_TRACE
 
 
 // --- local data
+DiagTask * DiagTask::spInstance = NULL;
+
+#if DIAGTASK_ENABLE_TRACE
+// not initialized at reset; keeps trace of previous boot
+static traceBuffer_t traceBuffer DIAGTASK_TRACE_ATTRIBUTE;
+
+// changes with the image: compile time and position of read-only data
+static const char traceImage[] = __DATE__ " " __TIME__;
+
+static uint32_t traceImageId()
+{
+  uint32_t id = 2166136261u ^ static_cast<uint32_t>(DIAGTASK_BUILD_ID);  // fnv-1a
+
+  for(const char * c = traceImage; *c; c++)
+  { id = (id ^ static_cast<uint8_t>(*c)) * 16777619u; }
+  return id ^ static_cast<uint32_t>(reinterpret_cast<uintptr_t>(traceImage));
+}
+#endif // DIAGTASK_ENABLE_TRACE
+
+#if DIAGTASK_ENABLE_VARIABLES
+static const char * const varTypeNames[] = { "bool", "u8", "i8", "u16", "i16", "u32", "i32", "float" };
+
+// number of bytes of one raw value in binary frames
+static const uint8_t varSize[] = { 1, 1, 1, 2, 2, 4, 4, 4 };
+#endif // DIAGTASK_ENABLE_VARIABLES
+
+#if DIAGTASK_ENABLE_LOG
+static const char * const logLevelNames[] = { "off", "error", "warning", "info", "debug", "verbose" };
+#endif // DIAGTASK_ENABLE_LOG
+
 // --- functions
 
 DiagTask::DiagTask(int (*getch)())
-      : mFeatures(feature_None), mCurrentValidInput(""), mGetchar(getch), mUptime(NULL), mReboot(NULL)
+      : mFeatures(feature_None), mCurrentValidInput(""), mGetchar(getch), mUptime(NULL), mReboot(NULL), mWrite(NULL)
+      , mTicks(NULL), mTicksPerSecond(1)
 {
+  privInit();
 };
 
 
 DiagTask::DiagTask(int (*getch)(), uint32_t (*uptime)())
-      : mFeatures(feature_None), mCurrentValidInput(""), mGetchar(getch), mUptime(uptime), mReboot(NULL)
+      : mFeatures(feature_None), mCurrentValidInput(""), mGetchar(getch), mUptime(uptime), mReboot(NULL), mWrite(NULL)
+      , mTicks(NULL), mTicksPerSecond(1)
 {
+  privInit();
 };
 
 DiagTask::DiagTask(int (*getch)(), uint32_t (*uptime)(), void (*reboot)())
-      : mFeatures(feature_None), mCurrentValidInput(""), mGetchar(getch), mUptime(uptime), mReboot(reboot)
+      : mFeatures(feature_None), mCurrentValidInput(""), mGetchar(getch), mUptime(uptime), mReboot(reboot), mWrite(NULL)
+      , mTicks(NULL), mTicksPerSecond(1)
 {
+  privInit();
 };
 
+void DiagTask::privInit()
+{
+  mBuiltins = feature_None;
+  mCurrentHook = NULL;
+  mJob.step = NULL;
+  mDescribe = NULL;
+#if DIAGTASK_NAME_POOL_LEN
+  mNamePoolLen = 0;
+#endif // DIAGTASK_NAME_POOL_LEN
+  spInstance = this;
+  privInvalidateHelp();
+
+#if DIAGTASK_ENABLE_CHUNKED_HOOKS
+  mChunkedHook.chunked = NULL;
+#endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+
+#if DIAGTASK_ENABLE_UPLOAD
+  mUploadSink = NULL;
+  mUploading = false;
+#endif // DIAGTASK_ENABLE_UPLOAD
+
+#if DIAGTASK_ENABLE_DOWNLOAD
+  mDownload.data = NULL;
+  mDownload.size = 0;
+#endif // DIAGTASK_ENABLE_DOWNLOAD
+
+#if DIAGTASK_ENABLE_SINKS
+  for(auto & sink : mSinks)
+  { sink.write = NULL; }
+  mSinkHead = 0;
+#endif // DIAGTASK_ENABLE_SINKS
+
+#if DIAGTASK_ENABLE_BUDGETS
+  mHookBudgetCount = 0;
+  mHookBudget = NULL;
+  mTruncated = false;
+  mUnlimited = false;
+  mInJob = false;
+  privInitBucket(mSessionBudget, 0, 0);
+#endif // DIAGTASK_ENABLE_BUDGETS
+
+#if DIAGTASK_ENABLE_COMPRESSION
+  mCompress = false;
+#endif // DIAGTASK_ENABLE_COMPRESSION
+
+#if DIAGTASK_ENABLE_LOG
+  for(uint32_t i = 0; i < DIAGTASK_LOG_ENTRIES; i++)
+  { mLog[i].sequence.store(i, std::memory_order_relaxed); }
+  mLogHead.store(0, std::memory_order_relaxed);
+  mLogTail = 0;
+  mLogDropped.store(0, std::memory_order_relaxed);
+#endif // DIAGTASK_ENABLE_LOG
+
+#if DIAGTASK_ENABLE_TRACE
+  // keep trace of previous boot if buffer content is valid
+  if(traceBuffer.magic != TRACE_MAGIC)
+  {
+    memset(traceBuffer.entries, 0, sizeof(traceBuffer.entries));
+    traceBuffer.index.store(0, std::memory_order_relaxed);
+    traceBuffer.boot = 0;
+    traceBuffer.image = 0;
+    traceBuffer.magic = TRACE_MAGIC;
+  }
+  traceBuffer.boot++;
+
+  // pointers stored by another image are not valid
+  if(traceBuffer.image != traceImageId())
+  {
+    traceBuffer.image = traceImageId();
+    traceBuffer.imageBoot = traceBuffer.boot;
+  }
+  privTrace(trace_Boot, 0);
+#endif // DIAGTASK_ENABLE_TRACE
+
+#if DIAGTASK_ENABLE_STREAM
+  mStreamCount = 0;
+  mStreamSeq = 0;
+  mStreamDelta = false;
+  mStreamDescribe = true;
+  mStreamKey = true;
+  mStreamPeriod = 0;
+  mStreamNext = 0;
+  mStreamHead.store(0, std::memory_order_relaxed);
+  mStreamTail.store(0, std::memory_order_relaxed);
+  mStreamDropped.store(0, std::memory_order_relaxed);
+#endif // DIAGTASK_ENABLE_STREAM
+
+#if DIAGTASK_ENABLE_TRIGGERS
+  mTriggerCount = 0;
+  mTriggerRunning = false;
+#endif // DIAGTASK_ENABLE_TRIGGERS
+
+#if DIAGTASK_ENABLE_MACROS
+  for(auto & m : mMacros)
+  { m.name[0] = '\0'; }
+  mMacroStepCount = 0;
+#endif // DIAGTASK_ENABLE_MACROS
+
+#if DIAGTASK_ENABLE_CAPTURE
+  mCaptureState = capture_Off;
+  mCaptureCount = 0;
+  mCapturePeriod = 0;
+#endif // DIAGTASK_ENABLE_CAPTURE
+}
+
 void DiagTask::process(void)
 {
   int c;
 
+#if DIAGTASK_ENABLE_COMPRESSION
+  // write output of last call
+  if(mCompress && mZipTokens)
+  { privZipControl(zip_Flush); }
+#endif // DIAGTASK_ENABLE_COMPRESSION
+
+#if DIAGTASK_ENABLE_SINKS
+  // sinks that were busy or limited by rate
+  privDrainSinks();
+#endif // DIAGTASK_ENABLE_SINKS
+
+#if DIAGTASK_ENABLE_LOG
+  privDrainLog();
+#endif // DIAGTASK_ENABLE_LOG
+
+#if DIAGTASK_ENABLE_STREAM
+  if(mStreamCount && mStreamPeriod && privDue(mStreamNext, mStreamPeriod))
+  {
+    streamSample();
+  }
+  privFlushStream();
+#endif // DIAGTASK_ENABLE_STREAM
+
+#if DIAGTASK_ENABLE_CAPTURE
+  if(mCapturePeriod && privDue(mCaptureNext, mCapturePeriod))
+  {
+    captureSample();
+  }
+#endif // DIAGTASK_ENABLE_CAPTURE
+
+#if DIAGTASK_ENABLE_TRIGGERS
+  evaluateTriggers();
+#endif // DIAGTASK_ENABLE_TRIGGERS
+
+#if DIAGTASK_ENABLE_BUDGETS
+  // job is suspended while output budget is exhausted
+  if(mJob.step && privTake(mSessionBudget, 1))
+  {
+    mInJob = true;
+    if(!(this->*mJob.step)())
+    { mJob.step = NULL; }
+    mInJob = false;
+  }
+#else
+  if(mJob.step && !(this->*mJob.step)())
+  { mJob.step = NULL; }
+#endif // DIAGTASK_ENABLE_BUDGETS
+
   // try to read one character
   if(!mGetchar) return;  // error, no function defined
 
+#if DIAGTASK_ENABLE_UPLOAD
+  // binary upload reads all received bytes itself
+  if(mUploading)
+  {
+    privProcessUpload();
+    return;
+  }
+#endif // DIAGTASK_ENABLE_UPLOAD
+
   c = mGetchar();
   if( c < 0 ) return;  // no byte was received
 
+#if DIAGTASK_ENABLE_CHUNKED_HOOKS
+  // rest of line belongs to chunked hook
+  if(mChunkedHook.chunked)
+  {
+    privProcessChunked(c);
+    return;
+  }
+#endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+
+  // ESC aborts a running command
+  if(c == KEY_ESC && mJob.step)
+  {
+    mJob.step = NULL;
+    privPrintf("\naborted\n");
+    return;
+  }
+
   // replace '\0' and '\r' with '\n'. those are only used for wildcard hooks.
   // this overcomes windows/linux eol and allows also '\0' to be used as end marker
   if ( c=='\0' || c== '\r')
@@ -104,8 +493,8 @@ void DiagTask::process(void)
       && (c != SPECIAL_KEYWORD_REBOOT    )
     )
   {
-    putchar(c);
-    fflush(stdout);
+    char ch = c;
+    privWrite(&ch, 1);
   }
 #endif
 
@@ -131,6 +520,10 @@ void DiagTask::process(void)
     {
       mCurrentValidInput[len] = c;
       mCurrentValidInput[len+1] = '\0';
+#if DIAGTASK_ENABLE_IGNORE_CASE
+      mFoldedInput[len] = privFold(c);
+      mFoldedInput[len+1] = '\0';
+#endif // DIAGTASK_ENABLE_IGNORE_CASE
     }
 
 // printf("%d, [%s]\n", len , mCurrentValidInput);
@@ -150,6 +543,59 @@ void DiagTask::process(void)
       mCurrentValidInput[0] = '\0';
       break;
     }
+#if DIAGTASK_ENABLE_CHUNKED_HOOKS
+    // chunked hook gets all characters behind wildcard position
+    else if(mFilterredHooks.size() == 1 && mHooks[mFilterredHooks[0].index].chunked
+            && strlen(mCurrentValidInput) >= static_cast<size_t>(
+                 privWildcard(mFilterredHooks[0].name) - mFilterredHooks[0].name))
+    {
+      privGetHook(mFilterredHooks[0].index, mFilterredHooks[0].name, mChunkedHook);
+      mCurrentValidInput[0] = '\0'; // reset input
+#if DIAGTASK_ENABLE_TRACE
+      privTrace(trace_Hook, privHookAddress(mChunkedHook), 0);
+#endif // DIAGTASK_ENABLE_TRACE
+      if(mChunkedHook.chunked->begin)
+      {
+        privSetCurrentHook(&mChunkedHook);
+        mChunkedHook.chunked->begin();
+        privSetCurrentHook(NULL);
+      }
+    }
+#endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+#if DIAGTASK_ENABLE_PATTERNS
+    // '\n' calls first pattern hook that matches the line (e.g. "dev <id> read <addr>")
+    else if(mCurrentValidInput[len] == '\n' && privProcessPatterns(len))
+    { }
+#endif // DIAGTASK_ENABLE_PATTERNS
+#if DIAGTASK_ENABLE_ABBREVIATIONS
+    // '\n' selects abbreviated hook (e.g. "n-s" for "net-stats") or wildcard hook.
+    // ambiguous input is dropped.
+    else if(mCurrentValidInput[len] == '\n')
+    {
+#if ENABLE_ECHO
+      privWrite("\n", 1);
+#endif // #if ENABLE_ECHO
+      const filterredHook_t * hook = mFilterredHooks.size() == 1 ? &mFilterredHooks[0] : NULL;
+      int16_t argIdx = hook ? privAbbreviation(hook->name, privMatchInput()) : -1;
+
+      // complete name is preferred to abbreviations of longer names (e.g. "s" and "stats")
+      for(auto & h : mFilterredHooks)
+      {
+        const char * wildcard = privWildcard(h.name);
+        uint16_t lenHook = wildcard ? wildcard - h.name : strlen(h.name);
+        if(privCommonPrefix(h.name, privMatchInput()) >= lenHook && (wildcard || lenHook == len))
+        {
+          hook = &h;
+          argIdx = lenHook;
+        }
+      }
+
+      mCurrentValidInput[len] = '\0'; // remove '\n'
+      if(argIdx >= 0)
+      { privCallHook(*hook, &mCurrentValidInput[argIdx]); }
+      mCurrentValidInput[0] = '\0'; // reset input
+    }
+#endif // DIAGTASK_ENABLE_ABBREVIATIONS
     // found hook with at least correct length (could be a wildcard hook)
     else
     {
@@ -159,29 +605,29 @@ void DiagTask::process(void)
               && strlen(mCurrentValidInput) >= strlen(mFilterredHooks[0].name) )
     {
       // check for wildcard hook
-      if(strchr(mFilterredHooks[0].name, SPECIAL_KEYWORD_WILDCARD))
+      if(privWildcard(mFilterredHooks[0].name))
       {
         // if we get '\n' then stop and execute hook
         if(    mCurrentValidInput[len] == '\n' )
         {
 #if ENABLE_ECHO
-          putchar('\n');
+          privWrite("\n", 1);
 #endif // #if ENABLE_ECHO
 
           mCurrentValidInput[len] = '\0'; // remove '\n'
           // find wildcard position at which the user argument starts
-            unsigned int argIdx = strchr(mFilterredHooks[0].name, SPECIAL_KEYWORD_WILDCARD)
+            unsigned int argIdx = privWildcard(mFilterredHooks[0].name)
                             - mFilterredHooks[0].name;
-            mFilterredHooks[0].hook(&mCurrentValidInput[argIdx]);
+            privCallHook(mFilterredHooks[0], &mCurrentValidInput[argIdx]);
           mCurrentValidInput[0] = '\0'; // reset input
         }
       }
       else
       {
 #if ENABLE_ECHO
-        putchar('\n');
+        privWrite("\n", 1);
 #endif // #if ENABLE_ECHO
-          mFilterredHooks[0].hook("");
+          privCallHook(mFilterredHooks[0], "");
         mCurrentValidInput[0] = '\0'; // reset input
         }
       }
@@ -204,215 +650,4282 @@ bool DiagTask::registerHook( const char * name, void(*hook)(const char* input)
   { return false; }
 
   hookEntry_t entry;
-  strncpy(entry.name, name, DIAGTASK_MAX_HOOKNAME_LEN);
-
-  entry.name[DIAGTASK_MAX_HOOKNAME_LEN] = '\0';
   entry.hook = hook;
-  if(description)
-  {
-    strncpy(entry.description, description, DIAGTASK_HOOKDESC_LEN);
-    entry.description[DIAGTASK_HOOKDESC_LEN] = '\0';
-  }
-  else
-  {
-    entry.description[0] = '\0';
-  }
-
-  //TODO insert sorted
-  mHooks.push_back(entry);
-  return true;
+#if DIAGTASK_ENABLE_CHUNKED_HOOKS
+  entry.chunked = NULL;
+#endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+#if DIAGTASK_ENABLE_PATTERNS
+  entry.argsHook = NULL;
+#endif // DIAGTASK_ENABLE_PATTERNS
+#if DIAGTASK_ENABLE_MACROS
+  entry.macro = 0;
+#endif // DIAGTASK_ENABLE_MACROS
+  return privAddHook(entry, name, description);
 }
 
-void DiagTask::enableFeatures(unsigned int features)
+#if DIAGTASK_ENABLE_CHUNKED_HOOKS
+bool DiagTask::registerChunkedHook( const char * name, const chunkedHook_t & hook
+                                  , const char * description)
 {
- mFeatures = features;
-}
+  if(!name || !hook.data || !privWildcard(name))
+  { return false; }
 
-bool DiagTask::executeHook(const char * name)
-{ //TODO: implement DiagTask::executeHook()
-  return false;
+  auto len = strlen(name);
+
+  if(len < DIAGTASK_MIN_HOOKNAME_LEN || len > DIAGTASK_MAX_HOOKNAME_LEN )
+  { return false; }
+
+  hookEntry_t entry;
+  entry.hook = NULL;
+  entry.chunked = &hook;
+#if DIAGTASK_ENABLE_PATTERNS
+  entry.argsHook = NULL;
+#endif // DIAGTASK_ENABLE_PATTERNS
+#if DIAGTASK_ENABLE_MACROS
+  entry.macro = 0;
+#endif // DIAGTASK_ENABLE_MACROS
+  return privAddHook(entry, name, description);
 }
 
-#if DIAGTASK_ENABLE_READ_KEY
-bool DiagTask::readKey(char & out, bool echo)
+void DiagTask::privProcessChunked(int c)
 {
-  int c = getchar();
-  if( c > 0 && c != 27) //ESC
+  char buffer[DIAGTASK_CHUNKED_HOOK_BUFFER];
+  uint16_t len = 0;
+
+  // collect characters that are already received
+  while(c >= 0 && c != '\n' && c != '\r' && c != '\0' && c != KEY_ESC)
   {
-    out = c;
-    if(echo) putchar(c);
-    return true;
+    buffer[len++] = c;
+    c = len < sizeof(buffer) ? mGetchar() : -1;
   }
-  return false;
+
+  privSetCurrentHook(&mChunkedHook);
+  if(len)
+  {
+#if ENABLE_ECHO
+    privWrite(buffer, len);
+#endif // ENABLE_ECHO
+    mChunkedHook.chunked->data(buffer, len);
+  }
+
+  // end of line or ESC
+  if(c >= 0)
+  {
+#if ENABLE_ECHO
+    privWrite("\n", 1);
+#endif // ENABLE_ECHO
+    const chunkedHook_t * hook = mChunkedHook.chunked;
+    mChunkedHook.chunked = NULL;
+    if(hook->end)
+    { hook->end(c != KEY_ESC); }
+  }
+  privSetCurrentHook(NULL);
 }
-#endif //DIAGTASK_ENABLE_READ_KEY
+#endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
 
-#if DIAGTASK_ENABLE_READ_INTEGER
-bool DiagTask::readInteger(int32_t & out, bool echo)
+#if DIAGTASK_ENABLE_PATTERNS
+bool DiagTask::registerPatternHook( const char * name, void(*hook)(uint8_t argc, char * argv[])
+                                  , const char * description)
 {
-  //TODO: implement DiagTask::readInteger()
-  return false;
-}
-#endif // DIAGTASK_ENABLE_READ_INTEGER
+  if(!name || !hook || !privWildcard(name))
+  { return false; }
 
-#if DIAGTASK_ENABLE_READ_HEX_INTEGER
-bool DiagTask::readHexInteger(uint32_t & out, bool echo)
-{ //TODO: implement DiagTask::readHexInteger()
-  return false;
-}
-#endif // DIAGTASK_ENABLE_READ_HEX_INTEGER
+  auto len = strlen(name);
 
-#if DIAGTASK_ENABLE_READ_STRING
-bool DiagTask::readString(char * out, uint16_t maxlen, bool echo)
-{ //TODO: implement DiagTask::readString()
-  return false;
+  if(len < DIAGTASK_MIN_HOOKNAME_LEN || len > DIAGTASK_MAX_HOOKNAME_LEN )
+  { return false; }
+
+  hookEntry_t entry;
+  entry.hook = NULL;
+#if DIAGTASK_ENABLE_CHUNKED_HOOKS
+  entry.chunked = NULL;
+#endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+  entry.argsHook = hook;
+#if DIAGTASK_ENABLE_MACROS
+  entry.macro = 0;
+#endif // DIAGTASK_ENABLE_MACROS
+  return privAddHook(entry, name, description);
 }
-#endif
 
-// diagtask.hpp excludes following files explicitly
-/// @cond
-void DiagTask::privFilterHooks()
+int8_t DiagTask::privMatchPattern(const char * pattern, const char * input, uint16_t (*bounds)[2])
 {
-  uint16_t lenHook;
-  uint16_t lenInput;
-  uint16_t lenMin;
-  const char *posWildcard;
+  const char * in = input;
+  int8_t argc = 0;
 
-  lenInput= strlen(mCurrentValidInput);
+  while(*pattern)
+  {
+    if(*pattern == SPECIAL_KEYWORD_WILDCARD || *pattern == '<')
+    {
+      const char * end = *pattern == '<' ? strchr(pattern, '>') : pattern;
+      if(!end || argc == DIAGTASK_MAX_PATTERN_ARGS)
+      { return -1; }
+      pattern = end + 1;
 
-  mFilterredHooks.clear();
+      // word ends at space or at next character of pattern (e.g. '=' of "* = *").
+      // last placeholder gets rest of line.
+      while(*in == ' ')
+      { in++; }
+      const char * start = in;
+      char next = pattern[strspn(pattern, " ")];
+      if(next == '<' || next == SPECIAL_KEYWORD_WILDCARD)
+      { next = ' '; }
 
-  if(lenInput > 0)
-  {
-  for (auto & h : mHooks)
-  {
-    //check until end of hookname and ignore wildcards. whildcards are later used to read
-    //until line end '\n'
-    //all hooks without wildcards do not have a '\n'
-    posWildcard = strchr(h.name, SPECIAL_KEYWORD_WILDCARD);
-    lenHook = posWildcard == NULL ? strlen(h.name) : ( posWildcard - h.name );
-      lenMin = std::min(lenHook, lenInput); // avoid illegal memory access
-
-      if( strncmp(h.name, mCurrentValidInput, lenMin) == 0
-        && lenInput <= lenHook // if we have two hooks 'aaa' and 'aaaa'  filterred strings would always
-                               // be more than one and no hook is called. Therefore ensure that longest
-                               // hook is called and mCurrentValidInput[] will be reset to accept other
-                               // hooks. Using hooks that start with same characters will anyway lead
-                               // to never call function for hook 'aaa'
-      )
+      if(next == '\0')
+      { in += strlen(in); }
+      else
+      {
+        while(*in && *in != ' ' && privFold(*in) != next)
+        { in++; }
+      }
+      if(in == start)
+      { return -1; }
+
+      if(bounds)
+      {
+        bounds[argc][0] = start - input;
+        bounds[argc][1] = in - input;
+      }
+      argc++;
+    }
+    else if(*pattern == ' ')
+    {
+      // any number of spaces
+      while(*in == ' ')
+      { in++; }
+      pattern++;
+    }
+    else if(privFold(*in) == *pattern)
     {
-        mFilterredHooks.push_back(h);
+      in++;
+      pattern++;
     }
+    else
+    { return -1; }
   }
+  return *in ? -1 : argc;
+}
+
+bool DiagTask::privCallPattern(const hookEntry_t & h, const char * input)
+{
+  uint16_t bounds[DIAGTASK_MAX_PATTERN_ARGS][2];
+  char * argv[DIAGTASK_MAX_PATTERN_ARGS];
+  char buffer[DIAGTASK_MAX_HOOK_INPUT_LEN+1];
+  int8_t argc = strlen(input) < sizeof(buffer) ? privMatchPattern(privWildcard(h.name), input, bounds) : -1;
+
+  if(argc < 0)
+  { return false; }
+
+  // split copy of input into words
+  strcpy(buffer, input);
+  for(int8_t i = 0; i < argc; i++)
+  {
+    buffer[bounds[i][1]] = '\0';
+    argv[i] = &buffer[bounds[i][0]];
   }
+  h.argsHook(argc, argv);
+  return true;
 }
 
-bool DiagTask::privCheckAndProcessSpecialChars(char input)
+bool DiagTask::privProcessPatterns(uint16_t len)
 {
-//printf("[%c](%d) buf:[%s]\n",input,input, mCurrentValidInput);
-  #if DIAGTASK_ENABLE_HELP
-    if( ( mFeatures & feature_Help ) && input == SPECIAL_KEYWORD_HELP)
-    {
-      privHelp();
-      mCurrentValidInput[0] = '\0'; // reset input
-      return true;
-    }
-  #endif //DIAGTASK_ENABLE_HELP
+  bool found = false;
 
-  #if DIAGTASK_ENABLE_SEPARATOR
-    if( ( mFeatures & feature_Seperator ) && input == SPECIAL_KEYWORD_SEPARATOR)
-    {
-      privDisplaySeparator();
-      mCurrentValidInput[0] = '\0'; // reset input
-      return true;
-    }
-  #endif //DIAGTASK_ENABLE_SEPARATOR
+  for(auto & h : mFilterredHooks)
+  { found = found || mHooks[h.index].argsHook; }
+  if(!found)
+  { return false; }
 
-  #if DIAGTASK_ENABLE_REBOOT
-    if( ( mFeatures & feature_Reboot )
-          && mReboot
-          && input == SPECIAL_KEYWORD_REBOOT)
-    {
-      printf("rebooting\n");
-      mReboot();
-      while(1);
-    }
-  #endif //DIAGTASK_ENABLE_REBOOT
+#if ENABLE_ECHO
+  privWrite("\n", 1);
+#endif // #if ENABLE_ECHO
+  mCurrentValidInput[len] = '\0'; // remove '\n'
+#if DIAGTASK_ENABLE_IGNORE_CASE
+  mFoldedInput[len] = '\0';
+#endif // DIAGTASK_ENABLE_IGNORE_CASE
 
-  #if DIAGTASK_ENABLE_SEARCH
-    if( ( mFeatures & feature_Search ) && input == SPECIAL_KEYWORD_SEARCH)
+  for(auto & h : mFilterredHooks)
+  {
+    if(!mHooks[h.index].argsHook)
+    { continue; }
+
+    // filterred hooks match input up to first placeholder
+#if DIAGTASK_ENABLE_ABBREVIATIONS
+    int16_t argIdx = privAbbreviation(h.name, privMatchInput());
+#else
+    int16_t argIdx = privWildcard(h.name) - h.name;
+#endif // DIAGTASK_ENABLE_ABBREVIATIONS
+    if(argIdx >= 0 && argIdx <= len
+        && privMatchPattern(privWildcard(h.name), &mCurrentValidInput[argIdx], NULL) >= 0)
     {
-      /*TODO: not implemented yet*/
+      privCallHook(h, &mCurrentValidInput[argIdx]);
       mCurrentValidInput[0] = '\0'; // reset input
-      printf("net yet implemented\n");
       return true;
     }
-  #endif //DIAGTASK_ENABLE_SEARCH
+  }
 
-  return false;
+  for(auto & h : mFilterredHooks)
+  {
+    if(mHooks[h.index].argsHook)
+    { privPrintf("usage: %s\n", h.name); }
+  }
+  mCurrentValidInput[0] = '\0'; // reset input
+  return true;
 }
+#endif // DIAGTASK_ENABLE_PATTERNS
 
-bool DiagTask::processTabCompetion(char input)
+bool DiagTask::privAddHook(hookEntry_t & entry, const char * name, const char * description)
 {
-#if DIAGTASK_ENABLE_TAB_COMPLETION
-    if( ( mFeatures & feature_TabCompletion ) && input == SPECIAL_KEYWORD_TAB)
-    {
-      if(mCurrentValidInput[0])
+  strncpy(entry.name, name, DIAGTASK_MAX_HOOKNAME_LEN);
+
+  entry.name[DIAGTASK_MAX_HOOKNAME_LEN] = '\0';
+#if DIAGTASK_ENABLE_IGNORE_CASE
+  // fold once, so input is compared without converting names
+  for(char * c = entry.name; *c; c++)
+  { *c = privFold(*c); }
+#endif // DIAGTASK_ENABLE_IGNORE_CASE
+#if DIAGTASK_HOOKDESC_LEN
+  if(description)
+  {
+    strncpy(entry.description, description, DIAGTASK_HOOKDESC_LEN);
+    entry.description[DIAGTASK_HOOKDESC_LEN] = '\0';
+  }
+  else
+  {
+    entry.description[0] = '\0';
+  }
+#else
+  entry.description = description ? description : "";
+#endif // DIAGTASK_HOOKDESC_LEN
+
+#if DIAGTASK_NAME_POOL_LEN
+  int32_t index = privPoolInsert(entry.name);
+  if(index < 0)
+  { return false; }
+  mHooks.insert(mHooks.begin() + index, entry);
+#else
+  //TODO insert sorted
+  mHooks.push_back(entry);
+  mHookNames.push_back(hookName_t());
+  strcpy(mHookNames.back().name, entry.name);
+#if DIAGTASK_HOOK_KEY_LEN
+  privUpdateKeys(mHookNames.size() - 1);
+#endif // DIAGTASK_HOOK_KEY_LEN
+#endif // DIAGTASK_NAME_POOL_LEN
+  privInvalidateHelp();
+  return true;
+}
+
+template<typename F>
+void DiagTask::privForEachHook(F f)
+{
+#if DIAGTASK_NAME_POOL_LEN
+  char name[DIAGTASK_MAX_HOOKNAME_LEN+1];
+  uint16_t offset = 0;
+
+  // decode names one after another
+  for(uint16_t i = 0; i < mHooks.size(); i++)
+  {
+    uint8_t shared = mNamePool[offset];
+    offset = privPoolNext(offset, name);
+    if(f(i, static_cast<const char *>(name), shared))
+    { return; }
+  }
+#else
+  for(uint16_t i = 0; i < mHookNames.size(); i++)
+  {
+    if(f(i, static_cast<const char *>(mHookNames[i].name), 0))
+    { return; }
+  }
+#endif // DIAGTASK_NAME_POOL_LEN
+}
+
+void DiagTask::privGetHook(uint16_t index, const char * name, hookEntry_t & entry) const
+{
+  static_cast<hookSlot_t &>(entry) = mHooks[index];
+  strcpy(entry.name, name);
+}
+
+#if DIAGTASK_HOOK_KEY_LEN && !DIAGTASK_NAME_POOL_LEN
+void DiagTask::privUpdateKeys(uint16_t from)
+{
+  uint16_t count = mHookNames.size();
+
+  // unused keys are 0 and never match input
+  mHookKeys.resize((count + 15) / 16);
+  for(uint16_t i = from; i < mHookKeys.size() * 16; i++)
+  {
+    const char * name = i < count ? mHookNames[i].name : "";
+    const char * posWildcard = privWildcard(name);
+    uint16_t lenHook = posWildcard ? posWildcard - name : strlen(name);
+
+    for(uint8_t c = 0; c < DIAGTASK_HOOK_KEY_LEN; c++)
+    {
+      mHookKeys[i / 16].column[c][i % 16] = c < lenHook ? name[c] : posWildcard ? 0xff : 0;
+    }
+  }
+}
+
+uint32_t DiagTask::privMatchKeys(const hookKeys_t & keys, const char * input, uint8_t n)
+{
+#if defined(__SSE2__)
+  const __m128i any = _mm_set1_epi8(static_cast<char>(0xff));
+  __m128i match = any;
+
+  for(uint8_t c = 0; c < n; c++)
+  {
+    __m128i column = _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys.column[c]));
+    __m128i equal = _mm_or_si128( _mm_cmpeq_epi8(column, _mm_set1_epi8(input[c]))
+                                , _mm_cmpeq_epi8(column, any));
+    match = _mm_and_si128(match, equal);
+  }
+  return _mm_movemask_epi8(match);
+#elif defined(__ARM_NEON)
+  static const uint8_t bits[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+  const uint8x16_t any = vdupq_n_u8(0xff);
+  uint8x16_t match = any;
+
+  for(uint8_t c = 0; c < n; c++)
+  {
+    uint8x16_t column = vld1q_u8(keys.column[c]);
+    uint8x16_t equal = vorrq_u8( vceqq_u8(column, vdupq_n_u8(static_cast<uint8_t>(input[c])))
+                               , vceqq_u8(column, any));
+    match = vandq_u8(match, equal);
+  }
+
+  // one bit per key: add weighted bytes of each half
+  match = vandq_u8(match, vld1q_u8(bits));
+  uint8x8_t sum = vpadd_u8(vget_low_u8(match), vget_high_u8(match));
+  sum = vpadd_u8(sum, sum);
+  sum = vpadd_u8(sum, sum);
+  return vget_lane_u8(sum, 0) | vget_lane_u8(sum, 1) << 8;
+#else
+  // compare 8 keys per 64 bit word
+  const uint64_t low = 0x7f7f7f7f7f7f7f7full;
+  uint64_t match[2] = { ~0ull, ~0ull };
+
+  // sets highest bit of each byte that is 0
+  auto zero = [low](uint64_t x) { return ~(((x & low) + low) | x | low); };
+
+  for(uint8_t c = 0; c < n && (match[0] | match[1]); c++)
+  {
+    uint64_t column[2];
+    uint64_t pattern = 0x0101010101010101ull * static_cast<uint8_t>(input[c]);
+
+    memcpy(column, keys.column[c], sizeof(column));
+    for(uint8_t w = 0; w < 2; w++)
+    { match[w] &= zero(column[w] ^ pattern) | zero(~column[w]); }
+  }
+
+  uint8_t bytes[16];
+  uint32_t result = 0;
+  memcpy(bytes, match, sizeof(bytes));
+  for(uint8_t k = 0; k < 16; k++)
+  { result |= (bytes[k] >> 7) << k; }
+  return result;
+#endif
+}
+#endif // DIAGTASK_HOOK_KEY_LEN && !DIAGTASK_NAME_POOL_LEN
+
+int DiagTask::privNameCompare(const char * a, const char * b, size_t n)
+{
+#if DIAGTASK_ENABLE_IGNORE_CASE
+  for( ; n; n--, a++, b++)
+  {
+    int diff = static_cast<uint8_t>(privFold(*a)) - static_cast<uint8_t>(privFold(*b));
+    if(diff || !*a)
+    { return diff; }
+  }
+  return 0;
+#else
+  return strncmp(a, b, n);
+#endif // DIAGTASK_ENABLE_IGNORE_CASE
+}
+
+const char * DiagTask::privWildcard(const char * name)
+{
+#if DIAGTASK_ENABLE_PATTERNS
+  return strpbrk(name, "*<");
+#else
+  return strchr(name, SPECIAL_KEYWORD_WILDCARD);
+#endif // DIAGTASK_ENABLE_PATTERNS
+}
+
+#if DIAGTASK_ENABLE_ABBREVIATIONS
+int16_t DiagTask::privAbbreviation(const char * name, const char * input)
+{
+  auto separator = [](char c) { return c && strchr("-._ /:", c); };
+  uint8_t i = 0;
+  int16_t j = 0;
+
+  const char * wildcard = privWildcard(name);
+
+  while(&name[i] != wildcard)
+  {
+    if(input[j] == '\0')
+    { return -2; }
+
+    if(input[j] == '\n')
+    {
+      // last segment of name may be abbreviated
+      for( ; name[i]; i++)
+      {
+        if(separator(name[i]))
+        { return -1; }
+      }
+      return j;
+    }
+
+    if(input[j] != name[i])
+    {
+      // skip rest of segment of name
+      if(!j || !separator(input[j]))
+      { return -1; }
+      while(name[i] && !separator(name[i]) && &name[i] != wildcard)
+      { i++; }
+      if(name[i] != input[j])
+      { return -1; }
+    }
+    i++;
+    j++;
+  }
+
+  // rest of input is argument
+  return j;
+}
+#endif // DIAGTASK_ENABLE_ABBREVIATIONS
+
+uint8_t DiagTask::privCommonPrefix(const char * a, const char * b)
+{
+  uint8_t n = 0;
+
+  while(a[n] && a[n] == b[n])
+  { n++; }
+  return n;
+}
+
+#if DIAGTASK_NAME_POOL_LEN
+uint16_t DiagTask::privPoolNext(uint16_t offset, char * name) const
+{
+  // record: number of characters shared with previous name, remaining characters, '\0'
+  uint8_t shared = mNamePool[offset];
+  uint8_t n = strlen(&mNamePool[offset + 1]);
+
+  memcpy(&name[shared], &mNamePool[offset + 1], n + 1);
+  return offset + n + 2;
+}
+
+int32_t DiagTask::privPoolInsert(const char * name)
+{
+  char prev[DIAGTASK_MAX_HOOKNAME_LEN+1] = "";
+  char next[DIAGTASK_MAX_HOOKNAME_LEN+1] = "";
+  uint16_t offset = 0;
+  uint16_t end = 0;
+  uint16_t index;
+
+  // find first name that sorts behind name
+  for(index = 0; index < mHooks.size(); index++)
+  {
+    end = privPoolNext(offset, next);
+    if(strcmp(next, name) > 0)
+    { break; }
+    strcpy(prev, next);
+    offset = end;
+  }
+
+  // record of name replaces record of next name, which is encoded again relative to name
+  char records[2 * (DIAGTASK_MAX_HOOKNAME_LEN + 2)];
+  uint16_t n = 0;
+  uint16_t replaced = 0;
+  uint8_t shared = privCommonPrefix(prev, name);
+
+  records[n++] = shared;
+  strcpy(&records[n], &name[shared]);
+  n += strlen(&name[shared]) + 1;
+  if(index < mHooks.size())
+  {
+    shared = privCommonPrefix(name, next);
+    records[n++] = shared;
+    strcpy(&records[n], &next[shared]);
+    n += strlen(&next[shared]) + 1;
+    replaced = end - offset;
+  }
+
+  if(mNamePoolLen + n - replaced > DIAGTASK_NAME_POOL_LEN)
+  { return -1; }
+
+  memmove(&mNamePool[offset + n], &mNamePool[offset + replaced], mNamePoolLen - offset - replaced);
+  memcpy(&mNamePool[offset], records, n);
+  mNamePoolLen += n - replaced;
+  return index;
+}
+
+void DiagTask::privPoolRemove(uint16_t index)
+{
+  char prev[DIAGTASK_MAX_HOOKNAME_LEN+1] = "";
+  char name[DIAGTASK_MAX_HOOKNAME_LEN+1];
+  uint16_t offset = 0;
+
+  for(uint16_t i = 0; i < index; i++)
+  { offset = privPoolNext(offset, prev); }
+
+  strcpy(name, prev);
+  uint16_t end = privPoolNext(offset, name);
+
+  // next name is encoded again relative to previous name
+  char record[DIAGTASK_MAX_HOOKNAME_LEN + 2];
+  uint16_t n = 0;
+  if(index + 1u < mHooks.size())
+  {
+    end = privPoolNext(end, name);
+    uint8_t shared = privCommonPrefix(prev, name);
+    record[n++] = shared;
+    strcpy(&record[n], &name[shared]);
+    n += strlen(&name[shared]) + 1;
+  }
+
+  memmove(&mNamePool[offset + n], &mNamePool[end], mNamePoolLen - end);
+  memcpy(&mNamePool[offset], record, n);
+  mNamePoolLen -= end - offset - n;
+}
+#endif // DIAGTASK_NAME_POOL_LEN
+
+bool DiagTask::unregisterHook(const char * name)
+{
+  if(!name)
+  { return false; }
+
+  int32_t index = -1;
+  privForEachHook([&](uint16_t i, const char * hookName, uint8_t)
+  {
+    if(privNameCompare(hookName, name, DIAGTASK_MAX_HOOKNAME_LEN + 1) == 0)
+    { index = i; }
+    return index >= 0;
+  });
+
+  if(index < 0)
+  { return false; }
+
+#if DIAGTASK_NAME_POOL_LEN
+  privPoolRemove(index);
+#else
+  mHookNames.erase(mHookNames.begin() + index);
+#if DIAGTASK_HOOK_KEY_LEN
+  privUpdateKeys(index);
+#endif // DIAGTASK_HOOK_KEY_LEN
+#endif // DIAGTASK_NAME_POOL_LEN
+  mHooks.erase(mHooks.begin() + index);
+
+  // filterred hooks are copies; rebuild them with next character
+  mFilterredHooks.clear();
+  mCurrentValidInput[0] = '\0';
+  privInvalidateHelp();
+  return true;
+}
+
+void DiagTask::setHookDescriptions(void (*describe)(const char * name, char * buf, uint16_t size))
+{
+  mDescribe = describe;
+  privInvalidateHelp();
+}
+
+void DiagTask::privInvalidateHelp()
+{
+#if DIAGTASK_ENABLE_HELP || DIAGTASK_ENABLE_TAB_COMPLETION
+  mHelpWidth = 0;
+#endif
+#if DIAGTASK_ENABLE_HELP && DIAGTASK_HELP_CACHE_LEN
+  mHelpLen = 0;
+#endif
+}
+
+#if DIAGTASK_ENABLE_HELP || DIAGTASK_ENABLE_TAB_COMPLETION
+uint8_t DiagTask::privHelpWidth()
+{
+  if(!mHelpWidth)
+  {
+    mHelpWidth = 1;
+    privForEachHook([this](uint16_t, const char * name, uint8_t)
+    {
+      mHelpWidth = std::max(mHelpWidth, static_cast<uint8_t>(strlen(name)));
+      return false;
+    });
+  }
+  return mHelpWidth;
+}
+
+const char * DiagTask::privDescription(const hookSlot_t & h, const char * name, char * buf, uint16_t size)
+{
+  if(h.description[0] || !mDescribe)
+  { return h.description; }
+
+  buf[0] = '\0';
+  mDescribe(name, buf, size);
+  buf[size - 1] = '\0';
+  return buf;
+}
+#endif
+
+void DiagTask::enableFeatures(unsigned int features)
+{
+ mFeatures = features;
+ privRegisterBuiltins();
+}
+
+void DiagTask::privRegisterBuiltins()
+{
+  unsigned int features = mFeatures & ~mBuiltins;
+
+#if DIAGTASK_ENABLE_LOG
+  if(features & feature_Log)
+  {
+    registerHook("log-level *", privCmdLogLevel, "log [module level]");
+  }
+#endif // DIAGTASK_ENABLE_LOG
+
+#if DIAGTASK_ENABLE_TRACE
+  if(features & feature_Trace)
+  {
+    registerHook("trace *", privCmdTrace, "trace [prev]");
+  }
+#endif // DIAGTASK_ENABLE_TRACE
+
+#if DIAGTASK_ENABLE_METRICS
+  if(features & feature_Metrics)
+  {
+    registerHook("metrics *", privCmdMetrics, "[reset|snap]");
+  }
+#endif // DIAGTASK_ENABLE_METRICS
+
+#if DIAGTASK_ENABLE_VARIABLES
+  if(features & feature_Variables)
+  {
+    registerHook("get *", privCmdGet, "get <var>..");
+    registerHook("set *", privCmdSet, "set <var> <value>");
+    registerHook("vars *", privCmdVars, "vars [prefix]");
+  }
+#endif // DIAGTASK_ENABLE_VARIABLES
+
+#if DIAGTASK_ENABLE_STREAM
+  if(features & feature_Stream)
+  {
+    registerHook("stream *", privCmdStream, "<rate|off> [d] <var>..");
+  }
+#endif // DIAGTASK_ENABLE_STREAM
+
+#if DIAGTASK_ENABLE_TRIGGERS
+  if(features & feature_Triggers)
+  {
+    registerHook("trig *", privCmdTrigger, "<cond> then <hook>");
+  }
+#endif // DIAGTASK_ENABLE_TRIGGERS
+
+#if DIAGTASK_ENABLE_CAPTURE
+  if(features & feature_Capture)
+  {
+    registerHook("cap *", privCmdCapture, "<rate> <post> <var>..");
+  }
+#endif // DIAGTASK_ENABLE_CAPTURE
+
+#if DIAGTASK_ENABLE_MEMORY
+  if(features & feature_Memory)
+  {
+    registerHook("md *", privCmdHexDump, "md <addr> <len>");
+    registerHook("mdb *", privCmdBinaryDump, "mdb <addr> <len>");
+    registerHook("find *", privCmdFind, "<addr> <len> <hex>");
+    registerHook("crc *", privCmdCrc, "crc <addr> <len>");
+    registerHook("sum *", privCmdSum, "sum <addr> <len>");
+  }
+#endif // DIAGTASK_ENABLE_MEMORY
+
+#if DIAGTASK_ENABLE_UPLOAD
+  if(features & feature_Upload)
+  {
+    registerHook("recv *", privCmdRecv, "recv <name>");
+  }
+#endif // DIAGTASK_ENABLE_UPLOAD
+
+#if DIAGTASK_ENABLE_DOWNLOAD
+  if(features & feature_Download)
+  {
+    registerHook("dl *", privCmdDownload, "<addr> <len>|trace|cap|resume <offset>");
+  }
+#endif // DIAGTASK_ENABLE_DOWNLOAD
+
+#if DIAGTASK_ENABLE_COMPRESSION
+  if(features & feature_Compression)
+  {
+    registerHook("compress *", privCmdCompress, "compress on|off");
+  }
+#endif // DIAGTASK_ENABLE_COMPRESSION
+
+#if DIAGTASK_ENABLE_SINKS
+  if(features & feature_Sinks)
+  {
+    registerHook("sinks", privCmdSinks, "list output sinks");
+  }
+#endif // DIAGTASK_ENABLE_SINKS
+
+#if DIAGTASK_ENABLE_MACROS
+  if(features & feature_Macros)
+  {
+    registerHook("alias *", privCmdMacro, "<name> = <hook>");
+    registerHook("macro *", privCmdMacro, "<name> = <hook>;..");
+  }
+#endif // DIAGTASK_ENABLE_MACROS
+
+  mBuiltins |= features;
+}
+
+void DiagTask::setOutput(void (*write)(const char* data, uint16_t len))
+{
+  mWrite = write;
+}
+
+void DiagTask::setTickSource(uint32_t (*ticks)(), uint32_t ticksPerSecond)
+{
+  mTicks = ticks;
+  mTicksPerSecond = ticks && ticksPerSecond ? ticksPerSecond : 1;
+}
+
+uint32_t DiagTask::privTicks()
+{
+  if(mTicks)
+  { return mTicks(); }
+  return mUptime ? mUptime() : 0;
+}
+
+void DiagTask::privCallHook(const filterredHook_t & h, const char * input)
+{
+  hookEntry_t entry;
+  privGetHook(h.index, h.name, entry);
+  privCallHook(entry, input);
+}
+
+void DiagTask::privCallHook(const hookEntry_t & h, const char * input)
+{
+#if DIAGTASK_ENABLE_TRACE
+  privTrace(trace_Hook, privHookAddress(h), strlen(input));
+#endif // DIAGTASK_ENABLE_TRACE
+
+  privSetCurrentHook(&h);
+#if DIAGTASK_ENABLE_MACROS
+  if(h.macro)
+  { privRunMacro(h.macro - 1, input); }
+  else
+#endif // DIAGTASK_ENABLE_MACROS
+#if DIAGTASK_ENABLE_CHUNKED_HOOKS
+  // whole argument is one chunk
+  if(h.chunked)
+  {
+    if(h.chunked->begin)
+    { h.chunked->begin(); }
+    h.chunked->data(input, strlen(input));
+    if(h.chunked->end)
+    { h.chunked->end(true); }
+  }
+  else
+#endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+#if DIAGTASK_ENABLE_PATTERNS
+  if(h.argsHook)
+  {
+    if(!privCallPattern(h, input))
+    { privPrintf("usage: %s\n", h.name); }
+  }
+  else
+#endif // DIAGTASK_ENABLE_PATTERNS
+  { h.hook(input); }
+  privSetCurrentHook(NULL);
+}
+
+bool DiagTask::executeHook(const char * name)
+{
+  const char * arg;
+  // hook may register other hooks; call a copy of the entry
+  hookEntry_t entry;
+
+  if(!privFindHook(name, &arg, entry))
+  { return false; }
+
+  privCallHook(entry, arg);
+  return true;
+}
+
+bool DiagTask::privFindHook(const char * name, const char ** arg, hookEntry_t & entry)
+{
+  bool found = false;
+
+  if(!name)
+  { return false; }
+
+  privForEachHook([&](uint16_t i, const char * hookName, uint8_t)
+  {
+    const char * posWildcard = privWildcard(hookName);
+    size_t len = posWildcard ? posWildcard - hookName : strlen(hookName);
+
+    if(privNameCompare(hookName, name, len) == 0 && (posWildcard || name[len] == '\0')
+#if DIAGTASK_ENABLE_PATTERNS
+       // several pattern hooks may start with the same text
+       && (!mHooks[i].argsHook || privMatchPattern(posWildcard, &name[len], NULL) >= 0)
+#endif // DIAGTASK_ENABLE_PATTERNS
+      )
+    {
+      *arg = posWildcard ? &name[len] : "";
+      privGetHook(i, hookName, entry);
+      found = true;
+    }
+    return found;
+  });
+  return found;
+}
+
+#if DIAGTASK_ENABLE_READ_KEY
+bool DiagTask::readKey(char & out, bool echo)
+{
+  int c = getchar();
+  if( c > 0 && c != 27) //ESC
+  {
+    out = c;
+    if(echo) privWrite(&out, 1);
+    return true;
+  }
+  return false;
+}
+#endif //DIAGTASK_ENABLE_READ_KEY
+
+#if DIAGTASK_ENABLE_READ_INTEGER
+bool DiagTask::readInteger(int32_t & out, bool echo)
+{
+  //TODO: implement DiagTask::readInteger()
+  return false;
+}
+#endif // DIAGTASK_ENABLE_READ_INTEGER
+
+#if DIAGTASK_ENABLE_READ_HEX_INTEGER
+bool DiagTask::readHexInteger(uint32_t & out, bool echo)
+{ //TODO: implement DiagTask::readHexInteger()
+  return false;
+}
+#endif // DIAGTASK_ENABLE_READ_HEX_INTEGER
+
+#if DIAGTASK_ENABLE_READ_STRING
+bool DiagTask::readString(char * out, uint16_t maxlen, bool echo)
+{ //TODO: implement DiagTask::readString()
+  return false;
+}
+#endif
+
+// diagtask.hpp excludes following files explicitly
+/// @cond
+void DiagTask::privFilterHooks()
+{
+  uint16_t lenInput = strlen(mCurrentValidInput);
+  const char * input = privMatchInput();
+
+  mFilterredHooks.clear();
+
+  if(lenInput > 0)
+  {
+#if DIAGTASK_HOOK_KEY_LEN && !DIAGTASK_NAME_POOL_LEN
+    // compare keys of 16 hooks at once up to '\n'; hooks with matching keys are compared completely
+    uint16_t n = std::min(static_cast<uint16_t>(strcspn(input, "\n")), static_cast<uint16_t>(DIAGTASK_HOOK_KEY_LEN));
+    n = std::max(static_cast<uint16_t>(1), n);  // unused keys must not match
+#if DIAGTASK_ENABLE_ABBREVIATIONS
+    // abbreviations match exactly up to first separator or '\n'
+    n = std::max(static_cast<uint16_t>(1), std::min(n, static_cast<uint16_t>(strcspn(input, "-._ /:\n"))));
+#endif // DIAGTASK_ENABLE_ABBREVIATIONS
+    for(uint16_t block = 0; block < mHookKeys.size(); block++)
+    {
+      for(uint32_t keys = privMatchKeys(mHookKeys[block], input, n); keys; keys &= keys - 1)
+      {
+#ifdef __GNUC__
+        uint16_t i = block * 16 + __builtin_ctz(keys);
+#else
+        uint16_t i = block * 16;
+        for(uint32_t k = keys; !(k & 1); k >>= 1)
+        { i++; }
+#endif
+        const char * name = mHookNames[i].name;
+        privFilterHook(i, name, privCommonPrefix(name, input), input, lenInput);
+      }
+    }
+#else
+    uint16_t matched = 0;  // number of characters of input that match current hook name
+
+    privForEachHook([&](uint16_t i, const char * name, uint8_t shared)
+    {
+      // front-coded names: if name shares more characters with previous name than matched the
+      // input, it differs from input at the same position. otherwise compare behind shared part.
+      if(shared <= matched)
+      { matched = shared + privCommonPrefix(&name[shared], &input[shared]); }
+
+      privFilterHook(i, name, matched, input, lenInput);
+      return false;
+    });
+#endif // DIAGTASK_HOOK_KEY_LEN && !DIAGTASK_NAME_POOL_LEN
+  }
+}
+
+void DiagTask::privFilterHook( uint16_t index, const char * name, uint16_t matched
+                             , const char * input, uint16_t lenInput)
+{
+  //check until end of hookname and ignore wildcards. whildcards are later used to read
+  //until line end '\n'
+  //all hooks without wildcards do not have a '\n'
+  const char * posWildcard = privWildcard(name);
+  uint16_t lenHook = posWildcard == NULL ? strlen(name) : ( posWildcard - name );
+  uint16_t lenMin = std::min(lenHook, lenInput); // avoid illegal memory access
+
+  bool match = matched >= lenMin
+      && (lenInput <= lenHook || posWildcard); // if we have two hooks 'aaa' and 'aaaa'  filterred strings would always
+                             // be more than one and no hook is called. Therefore ensure that longest
+                             // hook is called and mCurrentValidInput[] will be reset to accept other
+                             // hooks. Using hooks that start with same characters will anyway lead
+                             // to never call function for hook 'aaa'.
+                             // wildcard hooks accept any input behind wildcard position.
+
+  // '\n' behind complete name selects hook 'aaa' (e.g. alias "s" besides "stats")
+  if(!match && !posWildcard && lenInput == lenHook + 1 && matched >= lenHook && input[lenHook] == '\n')
+  { match = true; }
+
+#if DIAGTASK_ENABLE_ABBREVIATIONS
+  // chunked hooks get input behind their full name only
+  if(!match && privAbbreviation(name, input) != -1)
+  {
+  #if DIAGTASK_ENABLE_CHUNKED_HOOKS
+    match = !mHooks[index].chunked;
+  #else
+    match = true;
+  #endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+  }
+#else
+  (void)input;
+#endif // DIAGTASK_ENABLE_ABBREVIATIONS
+
+  if(match)
+  {
+      mFilterredHooks.push_back(filterredHook_t());
+      strcpy(mFilterredHooks.back().name, name);
+      mFilterredHooks.back().index = index;
+  }
+}
+
+bool DiagTask::privCheckAndProcessSpecialChars(char input)
+{
+//printf("[%c](%d) buf:[%s]\n",input,input, mCurrentValidInput);
+  #if DIAGTASK_ENABLE_TRACE
+    if(strchr("?#/", input))
+    { privTrace(trace_Command, input); }
+  #endif // DIAGTASK_ENABLE_TRACE
+
+  #if DIAGTASK_ENABLE_HELP
+    if( ( mFeatures & feature_Help ) && input == SPECIAL_KEYWORD_HELP)
+    {
+      privHelp();
+      mCurrentValidInput[0] = '\0'; // reset input
+      return true;
+    }
+  #endif //DIAGTASK_ENABLE_HELP
+
+  #if DIAGTASK_ENABLE_SEPARATOR
+    if( ( mFeatures & feature_Seperator ) && input == SPECIAL_KEYWORD_SEPARATOR)
+    {
+      privDisplaySeparator();
+      mCurrentValidInput[0] = '\0'; // reset input
+      return true;
+    }
+  #endif //DIAGTASK_ENABLE_SEPARATOR
+
+  #if DIAGTASK_ENABLE_REBOOT
+    if( ( mFeatures & feature_Reboot )
+          && mReboot
+          && input == SPECIAL_KEYWORD_REBOOT)
+    {
+      privPrintf("rebooting\n");
+    #if DIAGTASK_ENABLE_TRACE
+      privTrace(trace_Reboot, 0);
+    #endif // DIAGTASK_ENABLE_TRACE
+      mReboot();
+      while(1);
+    }
+  #endif //DIAGTASK_ENABLE_REBOOT
+
+  #if DIAGTASK_ENABLE_SEARCH
+    if( ( mFeatures & feature_Search ) && input == SPECIAL_KEYWORD_SEARCH)
+    {
+      /*TODO: not implemented yet*/
+      mCurrentValidInput[0] = '\0'; // reset input
+      privPrintf("net yet implemented\n");
+      return true;
+    }
+  #endif //DIAGTASK_ENABLE_SEARCH
+
+  return false;
+}
+
+bool DiagTask::processTabCompetion(char input)
+{
+#if DIAGTASK_ENABLE_TAB_COMPLETION
+    if( ( mFeatures & feature_TabCompletion ) && input == SPECIAL_KEYWORD_TAB)
+    {
+      if(mCurrentValidInput[0])
+      {
+      // show all hooks that start with mCurrentValidInput
+      // if we only have one hook, then call hook function
+
+        if(mFilterredHooks.size() == 1)
+      {
+          privPrintf("->%s\n", mFilterredHooks[0].name);
+          privCallHook(mFilterredHooks[0], "");
+        mCurrentValidInput[0] = '\0'; // reset input
+      }
+      else
+      {
+        auto len = strlen(mCurrentValidInput);
+        char description[DIAGTASK_PRINT_BUFFER_LEN];
+#if ENABLE_ECHO
+        privPrintf("\n");
+#endif // #if ENABLE_ECHO
+          for ( const auto & h: mFilterredHooks)
+        {
+          const char * text = privDescription(mHooks[h.index], h.name, description, sizeof(description));
+          privPrintf("[%s]%-*s\t", mCurrentValidInput, std::max(static_cast<int>(privHelpWidth() - len), 0),
+                     &h.name[len]);
+          privWrite(text, strlen(text));
+          privWrite("\n", 1);
+          }
+        }
+      }
+      return true;
+    }
+  #endif // DIAGTASK_ENABLE_TAB_COMPLETION
+
+  return false;
+}
+
+
+#if DIAGTASK_ENABLE_SINKS || DIAGTASK_ENABLE_BUDGETS
+void DiagTask::privInitBucket(tokenBucket_t & bucket, uint32_t rate, uint32_t burst)
+{
+  // tokens are signed
+  bucket.rate = rate;
+  bucket.burst = std::min(burst ? burst : rate, static_cast<uint32_t>(INT32_MAX));
+  bucket.tokens = bucket.burst;
+  bucket.last = privTicks();
+}
+
+uint32_t DiagTask::privTake(tokenBucket_t & bucket, uint32_t len)
+{
+  if(!bucket.rate)
+  { return len; }
+
+  uint32_t now = privTicks();
+  uint64_t refill = static_cast<uint64_t>(now - bucket.last) * bucket.rate / mTicksPerSecond;
+  if(refill)
+  {
+    bucket.tokens = std::min(static_cast<int64_t>(bucket.burst), bucket.tokens + static_cast<int64_t>(std::min(refill, static_cast<uint64_t>(UINT32_MAX))));
+    bucket.last = now;
+  }
+  return bucket.tokens > 0 ? std::min(len, static_cast<uint32_t>(bucket.tokens)) : 0;
+}
+#endif // DIAGTASK_ENABLE_SINKS || DIAGTASK_ENABLE_BUDGETS
+
+#if DIAGTASK_ENABLE_BUDGETS
+bool DiagTask::setOutputBudget(uint32_t bytesPerSecond, uint32_t burst)
+{
+  // without time, buckets are never refilled
+  if(bytesPerSecond && !mTicks && !mUptime)
+  { return false; }
+
+  privInitBucket(mSessionBudget, bytesPerSecond, burst);
+  return true;
+}
+
+bool DiagTask::setHookBudget(const char * name, uint32_t bytesPerSecond, uint32_t burst)
+{
+  hookBudget_t * budget = NULL;
+
+  // without time, buckets are never refilled
+  if(bytesPerSecond && !mTicks && !mUptime)
+  { return false; }
+
+  for(uint8_t i = 0; i < mHookBudgetCount; i++)
+  {
+    if(!strcmp(mHookBudgets[i].name, name))
+    { budget = &mHookBudgets[i]; }
+  }
+
+  if(!budget)
+  {
+    if(mHookBudgetCount >= DIAGTASK_MAX_HOOK_BUDGETS || strlen(name) > DIAGTASK_MAX_HOOKNAME_LEN)
+    { return false; }
+    budget = &mHookBudgets[mHookBudgetCount++];
+    strcpy(budget->name, name);
+  }
+
+  privInitBucket(budget->bucket, bytesPerSecond, burst);
+  return true;
+}
+
+uint16_t DiagTask::privBudget(uint16_t len)
+{
+  // output of jobs is not truncated; tokens become negative and job is suspended
+  if(mInJob)
+  {
+    if(mSessionBudget.rate)
+    { mSessionBudget.tokens -= len; }
+    return len;
+  }
+
+  uint16_t n = privTake(mSessionBudget, len);
+  if(mHookBudget)
+  { n = privTake(*mHookBudget, n); }
+
+  if(mSessionBudget.rate)
+  { mSessionBudget.tokens -= n; }
+  if(mHookBudget && mHookBudget->rate)
+  { mHookBudget->tokens -= n; }
+  return n;
+}
+#endif // DIAGTASK_ENABLE_BUDGETS
+
+void DiagTask::privSetCurrentHook(const hookEntry_t * hook)
+{
+  mCurrentHook = hook;
+
+#if DIAGTASK_ENABLE_BUDGETS
+  mHookBudget = NULL;
+  for(uint8_t i = 0; hook && i < mHookBudgetCount; i++)
+  {
+    if(!privNameCompare(mHookBudgets[i].name, hook->name, DIAGTASK_MAX_HOOKNAME_LEN + 1))
+    { mHookBudget = &mHookBudgets[i].bucket; }
+  }
+#endif // DIAGTASK_ENABLE_BUDGETS
+}
+
+void DiagTask::print(const char * fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  privVPrintf(fmt, ap);
+  va_end(ap);
+}
+
+#if DIAGTASK_ENABLE_SINKS
+static_assert((DIAGTASK_SINK_RING_LEN & (DIAGTASK_SINK_RING_LEN - 1)) == 0, "DIAGTASK_SINK_RING_LEN must be a power of 2");
+
+int DiagTask::addSink( int (*write)(const char * data, uint16_t len), uint32_t bytesPerSecond
+                     , sinkPolicy_t policy)
+{
+  if(!write)
+  { return -1; }
+
+  for(int id = 0; id < DIAGTASK_MAX_SINKS; id++)
+  {
+    sinkEntry_t & sink = mSinks[id];
+    if(sink.write)
+    { continue; }
+
+    // new sink receives only new output
+    sink.write = write;
+    sink.cursor = mSinkHead;
+    privInitBucket(sink.bucket, bytesPerSecond, 0);
+    sink.dropped = 0;
+    sink.policy = policy;
+    return id;
+  }
+  return -1;
+}
+
+bool DiagTask::removeSink(int id)
+{
+  if(id < 0 || id >= DIAGTASK_MAX_SINKS || !mSinks[id].write)
+  { return false; }
+
+  mSinks[id].write = NULL;
+  return true;
+}
+
+void DiagTask::privDrainSinks()
+{
+  for(auto & sink : mSinks)
+  {
+    if(!sink.write)
+    { continue; }
+
+    // write up to two contiguous parts of ring
+    while(sink.cursor != mSinkHead)
+    {
+      uint32_t pos = sink.cursor & (DIAGTASK_SINK_RING_LEN - 1);
+      uint32_t n = privTake(sink.bucket, std::min(mSinkHead - sink.cursor, DIAGTASK_SINK_RING_LEN - pos));
+      if(!n)
+      { break; }
+
+      int written = sink.write(&mSinkRing[pos], n);
+      if(written < 0)
+      {
+        // disconnected; skip pending output
+        sink.dropped += mSinkHead - sink.cursor;
+        sink.cursor = mSinkHead;
+        break;
+      }
+
+      sink.cursor += written;
+      if(sink.bucket.rate)
+      { sink.bucket.tokens -= written; }
+      if(static_cast<uint32_t>(written) < n)
+      { break; }
+    }
+  }
+}
+
+void DiagTask::privCmdSinks(const char *)
+{
+  DiagTask * self = spInstance;
+
+  for(int id = 0; id < DIAGTASK_MAX_SINKS; id++)
+  {
+    const sinkEntry_t & sink = self->mSinks[id];
+    if(sink.write)
+    {
+      self->privPrintf( "%d rate %lu pending %lu dropped %lu\n", id
+                      , static_cast<long unsigned int>(sink.bucket.rate)
+                      , static_cast<long unsigned int>(self->mSinkHead - sink.cursor)
+                      , static_cast<long unsigned int>(sink.dropped) );
+    }
+  }
+}
+#endif // DIAGTASK_ENABLE_SINKS
+
+#if DIAGTASK_ENABLE_COMPRESSION
+void DiagTask::setCompression(bool enable)
+{
+  if(enable == mCompress)
+  { return; }
+
+  if(enable)
+  {
+    // announce compression; decoder starts with empty window
+    uint8_t bits = DIAGTASK_COMPRESS_WINDOW_BITS;
+    privWriteFrame(0, STREAM_FRAME_COMPRESS, &bits, sizeof(bits));
+    mZipHead = 0;
+    mZipFilled = 0;
+    mZipTokens = 0;
+    mCompress = true;
+  }
+  else
+  {
+    privZipControl(zip_End);
+    mCompress = false;
+  }
+}
+
+void DiagTask::privCompress(const uint8_t * data, uint16_t len)
+{
+  for(uint16_t i = 0; i < len; )
+  {
+    uint16_t bestLen = 0;
+    uint16_t bestDist = 0;
+    uint16_t maxLen = std::min(static_cast<uint16_t>(len - i), static_cast<uint16_t>(ZIP_MAX_MATCH));
+
+    // longest match in window. bytes behind the window are taken from data (overlapping match)
+    if(maxLen >= ZIP_MIN_MATCH)
+    {
+      for(uint16_t dist = 1; dist <= mZipFilled; dist++)
+      {
+        uint16_t start = mZipHead - dist;
+        if(mZipWindow[start & ZIP_WINDOW_MASK] != data[i])
+        { continue; }
+
+        uint16_t n = 1;
+        while( n < maxLen
+               && (n < dist ? mZipWindow[(start + n) & ZIP_WINDOW_MASK] : data[i + n - dist]) == data[i + n] )
+        { n++; }
+
+        if(n > bestLen)
+        {
+          bestLen = n;
+          bestDist = dist;
+          if(n == maxLen)
+          { break; }
+        }
+      }
+    }
+
+    if(bestLen >= ZIP_MIN_MATCH)
+    { privZipToken(true, (bestDist - 1) << ZIP_LEN_BITS | (bestLen - ZIP_MIN_MATCH + 1)); }
+    else
+    {
+      bestLen = 1;
+      privZipToken(false, data[i]);
+    }
+
+    // add bytes to window
+    for(uint16_t n = 0; n < bestLen; n++)
+    { mZipWindow[mZipHead++ & ZIP_WINDOW_MASK] = data[i++]; }
+    mZipHead &= ZIP_WINDOW_MASK;
+    mZipFilled = std::min(static_cast<uint16_t>(mZipFilled + bestLen), static_cast<uint16_t>(ZIP_WINDOW_MASK + 1));
+  }
+}
+
+void DiagTask::privZipToken(bool match, uint16_t value)
+{
+  if(!mZipTokens)
+  {
+    mZipGroup[0] = 0;
+    mZipGroupLen = 1;
+  }
+
+  if(match)
+  {
+    mZipGroup[0] |= 1 << mZipTokens;
+    mZipGroup[mZipGroupLen++] = value >> 8;
+  }
+  mZipGroup[mZipGroupLen++] = value;
+
+  if(++mZipTokens == 8)
+  {
+    privWriteRaw(reinterpret_cast<const char *>(mZipGroup), mZipGroupLen);
+    mZipTokens = 0;
+  }
+}
+
+void DiagTask::privZipControl(uint8_t code)
+{
+  privZipToken(true, code << ZIP_LEN_BITS);
+  if(mZipTokens)
+  {
+    privWriteRaw(reinterpret_cast<const char *>(mZipGroup), mZipGroupLen);
+    mZipTokens = 0;
+  }
+}
+
+void DiagTask::privCmdCompress(const char * input)
+{
+  const char * arg;
+  uint16_t len = privNextArg(input, arg);
+
+  if(len == 2 && !strncmp(arg, "on", len))
+  { spInstance->setCompression(true); }
+  else if(len == 3 && !strncmp(arg, "off", len))
+  { spInstance->setCompression(false); }
+  else
+  { spInstance->privPrintf("usage: compress on|off\n"); }
+}
+#endif // DIAGTASK_ENABLE_COMPRESSION
+
+void DiagTask::privWrite(const char* data, uint16_t len)
+{
+#if DIAGTASK_ENABLE_BUDGETS
+  if(!mUnlimited)
+  {
+    uint16_t n = privBudget(len);
+    if(n < len)
+    {
+      // truncate first output that exceeds budget, drop following output until it fits again
+      if(!mTruncated)
+      {
+        privWriteOutput(data, n);
+        privWriteOutput(DIAGTASK_BUDGET_MARKER, sizeof(DIAGTASK_BUDGET_MARKER) - 1);
+        mTruncated = true;
+      }
+      return;
+    }
+    mTruncated = false;
+  }
+#endif // DIAGTASK_ENABLE_BUDGETS
+  privWriteOutput(data, len);
+}
+
+void DiagTask::privWriteOutput(const char* data, uint16_t len)
+{
+#if DIAGTASK_ENABLE_COMPRESSION
+  if(mCompress)
+  {
+    privCompress(reinterpret_cast<const uint8_t *>(data), len);
+    return;
+  }
+#endif // DIAGTASK_ENABLE_COMPRESSION
+  privWriteRaw(data, len);
+}
+
+void DiagTask::privWriteRaw(const char* data, uint16_t len)
+{
+#if DIAGTASK_ENABLE_SINKS
+  bool sinks = false;
+  for(const auto & sink : mSinks)
+  { sinks |= sink.write != NULL; }
+
+  while(sinks && len)
+  {
+    // write as much as possible before output of slow sinks is lost
+    privDrainSinks();
+
+    // ring may hold 64 KiB or more, which does not fit into uint16_t
+    uint16_t n = std::min(static_cast<uint32_t>(len), static_cast<uint32_t>(DIAGTASK_SINK_RING_LEN));
+    for(auto & sink : mSinks)
+    {
+      uint32_t pending = mSinkHead - sink.cursor;
+      if(!sink.write || pending + n <= DIAGTASK_SINK_RING_LEN)
+      { continue; }
+
+      uint32_t lost = sink.policy == sink_Resync ? pending : pending + n - DIAGTASK_SINK_RING_LEN;
+      sink.cursor += lost;
+      sink.dropped += lost;
+    }
+
+    uint32_t pos = mSinkHead & (DIAGTASK_SINK_RING_LEN - 1);
+    uint32_t first = std::min(static_cast<uint32_t>(n), DIAGTASK_SINK_RING_LEN - pos);
+    memcpy(&mSinkRing[pos], data, first);
+    memcpy(mSinkRing, data + first, n - first);
+    mSinkHead += n;
+    data += n;
+    len -= n;
+
+    if(!len)
+    {
+      privDrainSinks();
+      return;
+    }
+  }
+  if(sinks)
+  { return; }
+#endif // DIAGTASK_ENABLE_SINKS
+
+  if(mWrite)
+  {
+    mWrite(data, len);
+  }
+  else
+  {
+    fwrite(data, 1, len, stdout);
+    fflush(stdout);
+  }
+}
+
+void DiagTask::privPrintf(const char* fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  privVPrintf(fmt, ap);
+  va_end(ap);
+}
+
+void DiagTask::privVPrintf(const char* fmt, va_list ap)
+{
+  char buf[DIAGTASK_PRINT_BUFFER_LEN];
+  va_list args;
+
+  // long lines are truncated
+  va_copy(args, ap);
+  uint16_t len = privFormat(buf, sizeof(buf), fmt, [&args](uint8_t kind) { return privVaArg(args, kind); });
+  va_end(args);
+
+  privWrite(buf, len);
+}
+
+uint16_t DiagTask::format(char * buf, uint16_t size, const char * fmt, ...)
+{
+  va_list ap;
+
+  va_start(ap, fmt);
+  uint16_t len = privFormat(buf, size, fmt, [&ap](uint8_t kind) { return privVaArg(ap, kind); });
+  va_end(ap);
+  return len;
+}
+
+uint64_t DiagTask::privVaArg(va_list & ap, uint8_t kind)
+{
+  switch(kind)
+  {
+    case arg_Int:       return static_cast<uint64_t>(static_cast<int64_t>(va_arg(ap, int)));
+    case arg_Long:      return static_cast<uint64_t>(static_cast<int64_t>(va_arg(ap, long)));
+    case arg_LongLong:  return static_cast<uint64_t>(va_arg(ap, long long));
+    case arg_Double:
+    {
+      double d = va_arg(ap, double);
+      uint64_t raw;
+      memcpy(&raw, &d, sizeof(raw));
+      return raw;
+    }
+    default:            return reinterpret_cast<uintptr_t>(va_arg(ap, void *));
+  }
+}
+
+template<typename Next>
+uint16_t DiagTask::privFormat(char * buf, uint16_t size, const char * fmt, Next next)
+{
+  uint16_t len = 0;
+
+  if(!size)
+  { return 0; }
+
+  // appends n characters of s or n fill characters if s is NULL
+  auto put = [&](const char * s, uint16_t n, char fill)
+  {
+    for( ; n && len < size - 1; n--)
+    { buf[len++] = s ? *s++ : fill; }
+  };
+
+  while(*fmt && len < size - 1)
+  {
+    if(*fmt != '%')
+    {
+      buf[len++] = *fmt++;
+      continue;
+    }
+
+    // %[flags][width][.precision][length]conversion
+    const char * spec = fmt++;
+    bool left = false;
+    bool zero = false;
+    char sign = 0;
+    for( ; *fmt && strchr("-0+ #", *fmt); fmt++)
+    {
+      if(*fmt == '-')      { left = true; }
+      else if(*fmt == '0') { zero = true; }
+      else if(*fmt == '+') { sign = '+'; }
+      else if(*fmt == ' ') { sign = sign ? sign : ' '; }
+    }
+
+    int32_t width = 0;
+    if(*fmt == '*')
+    {
+      width = static_cast<int32_t>(next(arg_Int));
+      fmt++;
+      if(width < 0)
+      {
+        left = true;
+        width = -width;
+      }
+    }
+    for( ; isdigit(*fmt); fmt++)
+    { width = width * 10 + *fmt - '0'; }
+
+    int32_t precision = -1;
+    if(*fmt == '.')
+    {
+      fmt++;
+      precision = 0;
+      if(*fmt == '*')
+      {
+        precision = static_cast<int32_t>(next(arg_Int));
+        fmt++;
+      }
+      for( ; isdigit(*fmt); fmt++)
+      { precision = precision * 10 + *fmt - '0'; }
+    }
+
+    uint8_t kind = arg_Int;
+    uint8_t half = 0;   // 'h' narrows to short, "hh" to char
+    bool wide = false;
+    for( ; *fmt && strchr("hljztL", *fmt); fmt++)
+    {
+      wide = wide || *fmt == 'L';
+      half += *fmt == 'h';
+      if(*fmt == 'l')
+      { kind = kind == arg_Long ? arg_LongLong : arg_Long; }
+      else if(*fmt == 'z' || *fmt == 't')
+      { kind = sizeof(size_t) == sizeof(long) ? arg_Long : arg_LongLong; }
+      else if(*fmt != 'h')
+      { kind = arg_LongLong; }
+    }
+
+    char conversion = *fmt;
+    if(!conversion)
+    { break; }
+    fmt++;
+
+    char tmp[40];
+    const char * text = tmp;
+    uint16_t n = 0;
+    char prefix[2];
+    uint8_t prefixLen = 0;
+    bool number = true;
+
+    switch(conversion)
+    {
+      case 'd':
+      case 'i':
+      {
+        uint64_t raw = next(kind);
+        int64_t value = kind == arg_Int ? static_cast<int32_t>(raw)
+                      : kind == arg_Long ? static_cast<long>(raw) : static_cast<int64_t>(raw);
+        if(kind == arg_Int && half)
+        { value = half == 1 ? static_cast<int16_t>(raw) : static_cast<int8_t>(raw); }
+        if(value < 0)
+        { prefix[prefixLen++] = '-'; }
+        else if(sign)
+        { prefix[prefixLen++] = sign; }
+        n = privFormatInteger(tmp, value < 0 ? 0 - static_cast<uint64_t>(value) : value, 10, false);
+        break;
+      }
+      case 'o':
+      case 'u':
+      case 'x':
+      case 'X':
+      {
+        uint64_t raw = next(kind);
+        uint64_t value = kind == arg_Int ? static_cast<uint32_t>(raw)
+                       : kind == arg_Long ? static_cast<unsigned long>(raw) : raw;
+        if(kind == arg_Int && half)
+        { value = half == 1 ? static_cast<uint16_t>(raw) : static_cast<uint8_t>(raw); }
+        n = privFormatInteger(tmp, value, conversion == 'o' ? 8 : conversion == 'u' ? 10 : 16, conversion == 'X');
+        break;
+      }
+      case 'p':
+        prefix[prefixLen++] = '0';
+        prefix[prefixLen++] = 'x';
+        n = privFormatInteger(tmp, next(arg_Pointer), 16, false);
+        break;
+      case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+      {
+        if(wide)
+        { // long double is not supported, print the conversion as it is
+          text = spec;
+          n = fmt - spec;
+          number = false;
+          break;
+        }
+        uint64_t raw = next(arg_Double);
+        double value;
+        memcpy(&value, &raw, sizeof(value));
+        n = privFormatDouble(tmp, value, precision < 0 ? 6 : std::min(precision, static_cast<int32_t>(17)), conversion);
+        if(tmp[0] == '-')
+        {
+          prefix[prefixLen++] = '-';
+          text++;
+          n--;
+        }
+        else if(sign)
+        { prefix[prefixLen++] = sign; }
+        precision = -1;
+        break;
+      }
+      case 'c':
+        tmp[0] = static_cast<char>(next(arg_Int));
+        n = 1;
+        number = false;
+        break;
+      case 's':
+        text = reinterpret_cast<const char *>(static_cast<uintptr_t>(next(arg_Pointer)));
+        text = text ? text : "(null)";
+        while(text[n] && (precision < 0 || n < precision))
+        { n++; }
+        number = false;
+        break;
+      case '%':
+        tmp[0] = '%';
+        n = 1;
+        number = false;
+        break;
+      default:
+        // unsupported conversion (e.g. "%n"); print it as it is
+        text = spec;
+        n = fmt - spec;
+        number = false;
+        break;
+    }
+
+    // precision of integers is minimal number of digits
+    uint16_t zeros = 0;
+    if(number && precision > n)
+    { zeros = precision - n; }
+    else if(number && zero && !left && width > prefixLen + n)
+    { zeros = width - prefixLen - n; }
+
+    int32_t pad = width - prefixLen - zeros - n;
+    if(!left && pad > 0)
+    { put(NULL, pad, ' '); }
+    put(prefix, prefixLen, 0);
+    put(NULL, zeros, '0');
+    put(text, n, 0);
+    if(left && pad > 0)
+    { put(NULL, pad, ' '); }
+  }
+
+  buf[len] = '\0';
+  return len;
+}
+
+#if DIAGTASK_ENABLE_LOG
+bool DiagTask::privLog(const logModule_t * module, uint8_t level,
+                       const char * fmt, const uint64_t * args, uint8_t count)
+{
+  if(!fmt)
+  { return false; }
+
+#if DIAGTASK_ENABLE_TRACE
+  privTrace(trace_Log, reinterpret_cast<uintptr_t>(fmt), level);
+#endif // DIAGTASK_ENABLE_TRACE
+
+  // reserve an entry. an entry is free when its sequence equals the write position.
+  uint32_t pos = mLogHead.load(std::memory_order_relaxed);
+  logEntry_t * e;
+  for(;;)
+  {
+    e = &mLog[pos & (DIAGTASK_LOG_ENTRIES - 1)];
+    int32_t diff = static_cast<int32_t>(e->sequence.load(std::memory_order_acquire) - pos);
+
+    if(diff == 0)
+    {
+      if(mLogHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+      { break; }
+    }
+    else if(diff < 0)
+    {
+      // entry was not yet formatted by process(); ring buffer is full
+      mLogDropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    else
+    {
+      // another context has reserved this entry
+      pos = mLogHead.load(std::memory_order_relaxed);
+    }
+  }
+
+  e->fmt = fmt;
+  e->module = module;
+  e->level = level;
+  e->count = std::min(count, static_cast<uint8_t>(DIAGTASK_LOG_MAX_ARGS));
+  memcpy(e->args, args, e->count * sizeof(e->args[0]));
+
+  // publish entry to process()
+  e->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+void DiagTask::privDrainLog()
+{
+  char buf[DIAGTASK_PRINT_BUFFER_LEN];
+
+  uint32_t dropped = mLogDropped.exchange(0, std::memory_order_relaxed);
+  if(dropped)
+  {
+    privPrintf("log: %lu messages dropped\n", static_cast<long unsigned int>(dropped));
+  }
+
+  for(int n = 0; n < DIAGTASK_LOG_DRAIN_PER_PROCESS; n++)
+  {
+    logEntry_t & e = mLog[mLogTail & (DIAGTASK_LOG_ENTRIES - 1)];
+    if(e.sequence.load(std::memory_order_acquire) != mLogTail + 1)
+    { break; } // no more entries
+
+    uint16_t len = privFormatLog(buf, sizeof(buf), e);
+
+    // release entry for log()
+    e.sequence.store(mLogTail + DIAGTASK_LOG_ENTRIES, std::memory_order_release);
+    mLogTail++;
+
+    privWrite(buf, len);
+  }
+}
+
+uint16_t DiagTask::privFormatLog(char * buf, uint16_t size, const logEntry_t & entry)
+{
+  uint8_t arg = 0;
+  uint16_t len = 0;
+
+  if(entry.module)
+  {
+    len = format(buf, size, "%s %c: ", entry.module->mName,
+                 entry.level <= DIAGTASK_LOG_VERBOSE ? logLevelNames[entry.level][0] - ('a' - 'A') : '?');
+  }
+
+  // arguments are stored as raw 64 bit values; missing arguments are 0
+  return len + privFormat(&buf[len], size - len, entry.fmt,
+                          [&](uint8_t) -> uint64_t { return arg < entry.count ? entry.args[arg++] : 0; });
+}
+
+bool DiagTask::registerLogModule(logModule_t & module)
+{
+  if(!module.mName || mLogModules.size() >= mLogModules.max_size())
+  { return false; }
+
+  mLogModules.push_back(&module);
+  return true;
+}
+
+void DiagTask::privCmdLogLevel(const char * input)
+{
+  DiagTask * self = spInstance;
+  const char * name;
+  const char * value;
+  uint16_t lenName = privNextArg(input, name);
+  uint16_t lenValue = privNextArg(input, value);
+
+  // no arguments: list all modules
+  if(!lenName)
+  {
+    for(const auto m : self->mLogModules)
+    {
+      self->privPrintf("%-20s\t%s\n", m->mName, logLevelNames[std::min(m->mLevel.load(), static_cast<uint8_t>(DIAGTASK_LOG_VERBOSE))]);
+    }
+    return;
+  }
+
+  // level may be passed as number or name
+  int32_t level = -1;
+  if(lenValue && !privParseInt(value, lenValue, level))
+  {
+    for(uint8_t l = 0; l <= DIAGTASK_LOG_VERBOSE; l++)
+    {
+      if(strncmp(logLevelNames[l], value, lenValue) == 0)
+      {
+        level = l;
+        break;
+      }
+    }
+  }
+
+  if(level < DIAGTASK_LOG_OFF || level > DIAGTASK_LOG_VERBOSE)
+  {
+    self->privPrintf("invalid level\n");
+    return;
+  }
+
+  // '*' selects all modules
+  bool found = false;
+  for(auto m : self->mLogModules)
+  {
+    if( (lenName == 1 && name[0] == SPECIAL_KEYWORD_WILDCARD)
+        || (strlen(m->mName) == lenName && strncmp(m->mName, name, lenName) == 0) )
+    {
+      m->mLevel.store(level, std::memory_order_relaxed);
+      found = true;
+    }
+  }
+
+  if(!found)
+  { self->privPrintf("unknown module\n"); }
+}
+#endif // DIAGTASK_ENABLE_LOG
+
+#if DIAGTASK_ENABLE_TRACE
+void DiagTask::privTrace(uint8_t type, uintptr_t data, uint16_t arg)
+{
+  uint32_t idx = traceBuffer.index.fetch_add(1, std::memory_order_relaxed);
+  traceEntry_t & e = traceBuffer.entries[idx & (DIAGTASK_TRACE_ENTRIES - 1)];
+
+  e.time = privTicks();
+  e.data = data;
+  e.arg  = arg;
+  e.type = type;
+  e.boot = traceBuffer.boot;
+}
+
+void DiagTask::privDumpTrace(uint32_t boot)
+{
+  uint32_t idx = traceBuffer.index.load(std::memory_order_relaxed);
+
+  privPrintf("boot %lu\n", static_cast<long unsigned int>(boot));
+
+  // oldest entry is the one that is overwritten next
+  for(uint32_t n = 0; n < DIAGTASK_TRACE_ENTRIES; n++)
+  {
+    const traceEntry_t & e = traceBuffer.entries[(idx + n) & (DIAGTASK_TRACE_ENTRIES - 1)];
+    if(e.type == trace_Free || e.boot != static_cast<uint8_t>(boot))
+    { continue; }
+
+    privPrintf("%10lu  ", static_cast<long unsigned int>(e.time));
+    switch(e.type)
+    {
+      case trace_Boot:    privPrintf("boot\n"); break;
+      case trace_Reboot:  privPrintf("reboot\n"); break;
+      case trace_Command: privPrintf("cmd   %c\n", static_cast<char>(e.data)); break;
+      case trace_Log:
+      {
+        // print format string until end of line, if it belongs to this image
+        const char * fmt = reinterpret_cast<const char *>(e.data);
+        if(boot >= traceBuffer.imageBoot)
+        { privPrintf("log   %u %.*s\n", e.arg, static_cast<int>(strcspn(fmt, "\n")), fmt); }
+        else
+        { privPrintf("log   %u @%p\n", e.arg, static_cast<const void *>(fmt)); }
+        break;
+      }
+      case trace_Hook:
+      {
+        // hook functions are still valid after reboot, but hook entries are not.
+        // addresses of an earlier image may belong to other hooks now
+        bool found = false;
+        if(boot >= traceBuffer.imageBoot)
+        {
+          privForEachHook([&](uint16_t i, const char * name, uint8_t)
+          {
+            found = privHookAddress(mHooks[i]) == e.data;
+            if(found)
+            { privPrintf("hook  %s (%u)\n", name, e.arg); }
+            return found;
+          });
+        }
+        if(!found)
+        { privPrintf("hook  @%p (%u)\n", reinterpret_cast<const void *>(e.data), e.arg); }
+        break;
+      }
+      default:            privPrintf("?\n"); break;
+    }
+  }
+}
+
+void DiagTask::privCmdTrace(const char * input)
+{
+  DiagTask * self = spInstance;
+  const char * arg;
+  uint16_t len = privNextArg(input, arg);
+  uint32_t boot = traceBuffer.boot;
+
+  if(len == 4 && strncmp(arg, "prev", 4) == 0)
+  { boot--; }
+
+  self->privDumpTrace(boot);
+}
+#endif // DIAGTASK_ENABLE_TRACE
+
+#if DIAGTASK_ENABLE_METRICS
+bool DiagTask::privRegisterMetric(const char * name, void * metric, uint8_t type, const char * description)
+{
+  if(mMetrics.size() >= mMetrics.max_size() || !registerHook(name, privCmdMetric, description))
+  { return false; }
+
+  metricEntry_t m;
+  m.name = name;
+  m.metric = metric;
+  m.type = type;
+  m.snapshot = 0;
+  mMetrics.push_back(m);
+  return true;
+}
+
+void DiagTask::privPrintMetric(metricEntry_t & m, bool snapshot)
+{
+  switch(m.type)
+  {
+    case metric_Counter:
+    {
+      uint32_t value = static_cast<counter_t *>(m.metric)->value();
+      if(snapshot)
+      {
+        privPrintf("%-20s\t%10lu  +%lu\n", m.name, static_cast<long unsigned int>(value),
+                   static_cast<long unsigned int>(value - m.snapshot));
+        m.snapshot = value;
+      }
+      else
+      {
+        privPrintf("%-20s\t%10lu\n", m.name, static_cast<long unsigned int>(value));
+      }
+      break;
+    }
+
+    case metric_Gauge:
+      privPrintf("%-20s\t%10ld\n", m.name, static_cast<long int>(static_cast<gauge_t *>(m.metric)->value()));
+      break;
+
+    case metric_Timer:
+    {
+      uint32_t count = 0, total = 0, max = 0;
+      for(const auto & s : static_cast<timing_t *>(m.metric)->mShards)
+      {
+        count += s.count.load(std::memory_order_relaxed);
+        total += s.total.load(std::memory_order_relaxed);
+        max = std::max(max, s.max.load(std::memory_order_relaxed));
+      }
+      privPrintf("%-20s\t%10lu  avg %lu max %lu (%lu/s)\n", m.name, static_cast<long unsigned int>(count),
+                 static_cast<long unsigned int>(count ? total / count : 0),
+                 static_cast<long unsigned int>(max), static_cast<long unsigned int>(mTicksPerSecond));
+      break;
+    }
+  }
+}
+
+void DiagTask::privCmdMetrics(const char * input)
+{
+  DiagTask * self = spInstance;
+  const char * arg;
+  uint16_t len = privNextArg(input, arg);
+
+  bool reset = len == 5 && strncmp(arg, "reset", 5) == 0;
+  bool snapshot = len == 4 && strncmp(arg, "snap", 4) == 0;
+
+  for(auto & m : self->mMetrics)
+  {
+    if(reset)
+    {
+      if(m.type == metric_Counter)    { static_cast<counter_t *>(m.metric)->reset(); }
+      else if(m.type == metric_Timer) { static_cast<timing_t *>(m.metric)->reset(); }
+      m.snapshot = 0;
+    }
+    else
+    {
+      self->privPrintMetric(m, snapshot);
+    }
+  }
+}
+
+void DiagTask::privCmdMetric(const char * input)
+{
+  DiagTask * self = spInstance;
+  (void)input;
+
+  for(auto & m : self->mMetrics)
+  {
+    if(self->mCurrentHook && privNameCompare(m.name, self->mCurrentHook->name, DIAGTASK_MAX_HOOKNAME_LEN + 1) == 0)
+    {
+      self->privPrintMetric(m, false);
+      break;
+    }
+  }
+}
+#endif // DIAGTASK_ENABLE_METRICS
+
+#if DIAGTASK_ENABLE_VARIABLES
+bool DiagTask::privRegisterVariable(const char * name, void * variable, uint8_t type,
+                                    uint8_t flags, int32_t min, int32_t max)
+{
+  if(!name || !variable)
+  { return false; }
+
+  auto len = strlen(name);
+  if( len < DIAGTASK_MIN_HOOKNAME_LEN || len > DIAGTASK_MAX_HOOKNAME_LEN
+      || mVariables.size() >= mVariables.max_size() || privFindVariable(name, len))
+  { return false; }
+
+  varEntry_t v;
+  v.name = name;
+  v.variable = variable;
+  v.min = min;
+  v.max = max;
+  v.type = type;
+  v.flags = flags;
+  mVariables.push_back(v);
+  return true;
+}
+
+DiagTask::varEntry_t * DiagTask::privFindVariable(const char * name, uint16_t len)
+{
+  for(auto & v : mVariables)
+  {
+    if(strncmp(v.name, name, len) == 0 && v.name[len] == '\0')
+    { return &v; }
+  }
+  return NULL;
+}
+
+uint32_t DiagTask::privReadVariable(const varEntry_t & v)
+{
+  switch(v.type)
+  {
+    case var_Bool:  return *static_cast<const bool *>(v.variable);
+    case var_U8:    return *static_cast<const uint8_t *>(v.variable);
+    case var_I8:    return *static_cast<const int8_t *>(v.variable);
+    case var_U16:   return *static_cast<const uint16_t *>(v.variable);
+    case var_I16:   return *static_cast<const int16_t *>(v.variable);
+    case var_U32:   return *static_cast<const uint32_t *>(v.variable);
+    case var_I32:   return *static_cast<const int32_t *>(v.variable);
+    case var_Float:
+    {
+      uint32_t raw;
+      memcpy(&raw, v.variable, sizeof(raw));
+      return raw;
+    }
+  }
+  return 0;
+}
+
+uint8_t DiagTask::privSelectVariables(const char * names, uint8_t * vars, uint8_t max)
+{
+  uint8_t count = 0;
+  const char * name;
+  uint16_t len;
+
+  if(!names)
+  { return 0; }
+
+  while( (len = privNextArg(names, name)) )
+  {
+    const varEntry_t * v = privFindVariable(name, len);
+    if(!v || count >= max)
+    { return 0; }
+    vars[count++] = v - &mVariables[0];
+  }
+  return count;
+}
+
+uint16_t DiagTask::privDescribeVariables(const uint8_t * vars, uint8_t count, uint8_t * desc)
+{
+  uint16_t n = 0;
+  for(uint8_t i = 0; i < count; i++)
+  {
+    const varEntry_t & v = mVariables[vars[i]];
+    uint8_t len = strlen(v.name);
+    desc[n++] = v.type;
+    memcpy(&desc[n], v.name, len + 1);
+    n += len + 1;
+  }
+  return n;
+}
+
+bool DiagTask::privSamplePeriod(uint32_t rate, uint32_t & period)
+{
+  // rate above resolution of tick source would silently be lowered
+  period = rate ? mTicksPerSecond / rate : 0;
+  return !rate || (period && (mTicks || mUptime));
+}
+
+uint8_t DiagTask::privFormatVariable(char * buf, const varEntry_t & v)
+{
+  switch(v.type)
+  {
+    case var_Bool:  return privFormatUnsigned(buf, *static_cast<const bool *>(v.variable));
+    case var_U8:    return privFormatUnsigned(buf, *static_cast<const uint8_t *>(v.variable));
+    case var_I8:    return privFormatSigned(buf, *static_cast<const int8_t *>(v.variable));
+    case var_U16:   return privFormatUnsigned(buf, *static_cast<const uint16_t *>(v.variable));
+    case var_I16:   return privFormatSigned(buf, *static_cast<const int16_t *>(v.variable));
+    case var_U32:   return privFormatUnsigned(buf, *static_cast<const uint32_t *>(v.variable));
+    case var_I32:   return privFormatSigned(buf, *static_cast<const int32_t *>(v.variable));
+    case var_Float: return privFormatFloat(buf, *static_cast<const float *>(v.variable),
+                                           DIAGTASK_VARIABLE_FLOAT_DIGITS);
+  }
+  return 0;
+}
+
+const char * DiagTask::privWriteVariable(const varEntry_t & v, const char * value, uint16_t len)
+{
+  if(v.flags & var_ReadOnly)
+  { return "read only"; }
+
+  if(v.type == var_Float)
+  {
+    // parse [-]digits[.digits]
+    float f = 0.0f;
+    float scale = 0.0f;
+    bool negative = len && *value == '-';
+    bool digits = false;
+
+    for(uint16_t i = negative ? 1 : 0; i < len; i++)
+    {
+      if(value[i] == '.' && scale == 0.0f)
+      {
+        scale = 1.0f;
+      }
+      else if(value[i] >= '0' && value[i] <= '9')
+      {
+        digits = true;
+        if(scale == 0.0f)
+        { f = f * 10.0f + (value[i] - '0'); }
+        else
+        {
+          scale /= 10.0f;
+          f += (value[i] - '0') * scale;
+        }
+      }
+      else
+      { return "invalid value"; }
+    }
+
+    if(!digits)
+    { return "invalid value"; }
+
+    if(negative)
+    { f = -f; }
+
+    if((v.flags & var_Range) && (f < v.min || f > v.max))
+    { return "out of range"; }
+
+    *static_cast<float *>(v.variable) = f;
+    return NULL;
+  }
+
+  int64_t n;
+  if(!privParseNumber(value, len, n))
+  {
+    // accept some words for boolean values
+    if(v.type == var_Bool && (strncmp(value, "true", len) == 0 || strncmp(value, "on", len) == 0))
+    { n = 1; }
+    else if(v.type == var_Bool && (strncmp(value, "false", len) == 0 || strncmp(value, "off", len) == 0))
+    { n = 0; }
+    else
+    { return "invalid value"; }
+  }
+
+  // limits of type
+  static const int64_t limits[][2] =
+  {
+    { 0, 1 },                   // var_Bool
+    { 0, UINT8_MAX },           // var_U8
+    { INT8_MIN, INT8_MAX },     // var_I8
+    { 0, UINT16_MAX },          // var_U16
+    { INT16_MIN, INT16_MAX },   // var_I16
+    { 0, UINT32_MAX },          // var_U32
+    { INT32_MIN, INT32_MAX }    // var_I32
+  };
+
+  if( n < limits[v.type][0] || n > limits[v.type][1]
+      || ((v.flags & var_Range) && (n < v.min || n > v.max)) )
+  { return "out of range"; }
+
+  switch(v.type)
+  {
+    case var_Bool: *static_cast<bool *>(v.variable)     = n != 0; break;
+    case var_U8:   *static_cast<uint8_t *>(v.variable)  = n; break;
+    case var_I8:   *static_cast<int8_t *>(v.variable)   = n; break;
+    case var_U16:  *static_cast<uint16_t *>(v.variable) = n; break;
+    case var_I16:  *static_cast<int16_t *>(v.variable)  = n; break;
+    case var_U32:  *static_cast<uint32_t *>(v.variable) = n; break;
+    case var_I32:  *static_cast<int32_t *>(v.variable)  = n; break;
+  }
+  return NULL;
+}
+
+void DiagTask::privCmdGet(const char * input)
+{
+  DiagTask * self = spInstance;
+  const char * name;
+  uint16_t len;
+  char buf[DIAGTASK_MAX_HOOKNAME_LEN + 24];
+
+  while( (len = privNextArg(input, name)) )
+  {
+    const varEntry_t * v = self->privFindVariable(name, len);
+    if(!v)
+    {
+      self->privPrintf("%.*s: unknown variable\n", len, name);
+      continue;
+    }
+
+    uint8_t n = strlen(v->name);
+    memcpy(buf, v->name, n);
+    memcpy(&buf[n], " = ", 3);
+    n += 3;
+    n += privFormatVariable(&buf[n], *v);
+    buf[n++] = '\n';
+    self->privWrite(buf, n);
+  }
+}
+
+void DiagTask::privCmdSet(const char * input)
+{
+  DiagTask * self = spInstance;
+  const char * name;
+  const char * value;
+  uint16_t lenName = privNextArg(input, name);
+  uint16_t lenValue = privNextArg(input, value);
+
+  const varEntry_t * v = self->privFindVariable(name, lenName);
+  const char * error = v ? (lenValue ? privWriteVariable(*v, value, lenValue) : "missing value")
+                         : "unknown variable";
+  if(error)
+  {
+    self->privPrintf("%.*s: %s\n", lenName, name, error);
+  }
+}
+
+void DiagTask::privCmdVars(const char * input)
+{
+  DiagTask * self = spInstance;
+  const char * prefix;
+  uint16_t len = privNextArg(input, prefix);
+  char value[20];
+
+  for(const auto & v : self->mVariables)
+  {
+    if(strncmp(v.name, prefix, len) != 0)
+    { continue; }
+
+    value[privFormatVariable(value, v)] = '\0';
+    self->privPrintf("%-20s\t%-5s %s", v.name, varTypeNames[v.type], value);
+    if(v.flags & var_Range)
+    {
+      self->privPrintf(" [%ld..%ld]", static_cast<long int>(v.min), static_cast<long int>(v.max));
+    }
+    self->privPrintf("%s\n", v.flags & var_ReadOnly ? " ro" : "");
+  }
+}
+#endif // DIAGTASK_ENABLE_VARIABLES
+
+#if DIAGTASK_ENABLE_STREAM
+bool DiagTask::startStream(const char * variables, uint32_t rate, bool delta)
+{
+  uint8_t vars[DIAGTASK_STREAM_MAX_VARIABLES];
+  uint8_t count = privSelectVariables(variables, vars, DIAGTASK_STREAM_MAX_VARIABLES);
+  uint32_t period;
+
+  if(!count || !privSamplePeriod(rate, period))
+  { return false; }
+
+  stopStream();
+  memcpy(mStreamVars, vars, count);
+  mStreamDelta = delta;
+  mStreamKey = true;
+  mStreamDescribe = true;
+  mStreamSeq = 0;
+  mStreamPeriod = period;
+  mStreamNext = privTicks();
+  mStreamCount = count;
+  return true;
+}
+
+void DiagTask::stopStream()
+{
+  mStreamCount = 0;
+}
+
+bool DiagTask::streamSample()
+{
+  // largest frame is a delta frame with 5 byte varints
+  uint8_t payload[DIAGTASK_STREAM_MAX_VARIABLES * 5];
+  uint8_t len = 0;
+  uint8_t count = mStreamCount;
+
+  if(!count)
+  { return false; }
+
+  // receiver needs names and types; repeat them when sequence number wraps around.
+  // a description that did not fit into the buffer is sent again before the next sample.
+  if(mStreamSeq == 0)
+  { mStreamDescribe = true; }
+  if(mStreamDescribe)
+  {
+    uint8_t desc[DIAGTASK_STREAM_MAX_VARIABLES * (DIAGTASK_MAX_HOOKNAME_LEN + 2)];
+    uint16_t n = privDescribeVariables(mStreamVars, count, desc);
+    mStreamDescribe = !privStreamFrame(STREAM_FRAME_DESCRIPTION, desc, std::min(n, static_cast<uint16_t>(UINT8_MAX)));
+    // receiver drops samples until it has the description; first one must be complete
+    mStreamKey = true;
+  }
+
+  bool delta = mStreamDelta && !mStreamKey && (mStreamSeq % DIAGTASK_STREAM_KEYFRAME) != 0;
+
+  for(uint8_t i = 0; i < count; i++)
+  {
+    const varEntry_t & v = mVariables[mStreamVars[i]];
+    uint32_t value = privReadVariable(v);
+
+    if(delta && v.type != var_Float)
+    {
+      // zigzag encoding keeps small negative differences small
+      int32_t diff = static_cast<int32_t>(value - static_cast<uint32_t>(mStreamPrev[i]));
+      uint32_t zigzag = (static_cast<uint32_t>(diff) << 1) ^ static_cast<uint32_t>(diff >> 31);
+      do
+      {
+        payload[len++] = (zigzag & 0x7F) | (zigzag > 0x7F ? 0x80 : 0);
+        zigzag >>= 7;
+      } while(zigzag);
+    }
+    else
+    {
+      for(uint8_t b = 0; b < varSize[v.type]; b++)
+      { payload[len++] = value >> (8 * b); }
+    }
+    mStreamPrev[i] = value;
+  }
+
+  if(!privStreamFrame(delta ? STREAM_FRAME_DELTA : STREAM_FRAME_KEY, payload, len))
+  {
+    // receiver detects missing sequence number; next sample must be complete
+    mStreamKey = true;
+    mStreamSeq++;
+    mStreamDropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  mStreamKey = false;
+  mStreamSeq++;
+  return true;
+}
+
+bool DiagTask::privStreamFrame(uint8_t type, const uint8_t * payload, uint8_t len)
+{
+  uint8_t header[4] = { FRAME_SYNC, len, mStreamSeq, type };
+  uint8_t crc = privCrc8(privCrc8(0, &header[1], 3), payload, len);
+  uint16_t size = len + sizeof(header) + 1;
+
+  uint16_t head = mStreamHead.load(std::memory_order_relaxed);
+  uint16_t tail = mStreamTail.load(std::memory_order_acquire);
+  uint16_t used = (head - tail + DIAGTASK_STREAM_BUFFER_LEN) % DIAGTASK_STREAM_BUFFER_LEN;
+
+  // one byte stays free to distinguish full from empty
+  if(used + size >= DIAGTASK_STREAM_BUFFER_LEN)
+  { return false; }
+
+  auto put = [&](uint8_t b)
+  {
+    mStreamBuf[head] = b;
+    head = (head + 1) % DIAGTASK_STREAM_BUFFER_LEN;
+  };
+
+  for(uint8_t b : header)
+  { put(b); }
+  for(uint8_t i = 0; i < len; i++)
+  { put(payload[i]); }
+  put(crc);
+
+  mStreamHead.store(head, std::memory_order_release);
+  return true;
+}
+
+void DiagTask::privFlushStream()
+{
+  uint16_t head = mStreamHead.load(std::memory_order_acquire);
+  uint16_t tail = mStreamTail.load(std::memory_order_relaxed);
+
+  while(tail != head)
+  {
+    // write contiguous part of ring buffer
+    uint16_t end = head > tail ? head : DIAGTASK_STREAM_BUFFER_LEN;
+    privWrite(reinterpret_cast<const char *>(&mStreamBuf[tail]), end - tail);
+    tail = end % DIAGTASK_STREAM_BUFFER_LEN;
+  }
+
+  mStreamTail.store(tail, std::memory_order_release);
+}
+
+void DiagTask::privCmdStream(const char * input)
+{
+  DiagTask * self = spInstance;
+  const char * arg;
+  uint16_t len = privNextArg(input, arg);
+  int32_t rate;
+
+  if(!len)
+  {
+    self->privPrintf("%u variables, %lu dropped\n", self->mStreamCount,
+                     static_cast<long unsigned int>(self->mStreamDropped.load()));
+    return;
+  }
+
+  if(len == 3 && strncmp(arg, "off", 3) == 0)
+  {
+    self->stopStream();
+    return;
+  }
+
+  uint32_t period;
+  if(!privParseInt(arg, len, rate) || rate < 0 || !self->privSamplePeriod(rate, period))
+  {
+    self->privPrintf("invalid rate\n");
+    return;
+  }
+
+  // optional 'd' selects delta mode
+  const char * vars = input;
+  bool delta = privNextArg(input, arg) == 1 && arg[0] == 'd';
+  if(delta)
+  { vars = input; }
+
+  if(!self->startStream(vars, rate, delta))
+  {
+    self->privPrintf("invalid variables\n");
+  }
+}
+#endif // DIAGTASK_ENABLE_STREAM
+
+#if DIAGTASK_ENABLE_CAPTURE
+bool DiagTask::startCapture(const char * variables, uint32_t rate, uint16_t postSamples)
+{
+  uint8_t vars[DIAGTASK_CAPTURE_MAX_VARIABLES];
+  uint8_t count = privSelectVariables(variables, vars, DIAGTASK_CAPTURE_MAX_VARIABLES);
+
+  if(!count)
+  { return false; }
+
+  uint8_t sampleLen = 0;
+  for(uint8_t i = 0; i < count; i++)
+  { sampleLen += varSize[mVariables[vars[i]].type]; }
+
+  uint16_t samples = DIAGTASK_CAPTURE_BUFFER_LEN / sampleLen;
+  uint32_t period;
+  if(postSamples > samples || !privSamplePeriod(rate, period))
+  { return false; }
+
+  stopCapture();
+  memcpy(mCaptureVars, vars, count);
+  mCaptureCount = count;
+  mCaptureSampleLen = sampleLen;
+  mCaptureSamples = samples;
+  mCaptureIndex = 0;
+  mCaptureFilled = 0;
+  mCapturePost = postSamples;
+  mCapturePeriod = period;
+  mCaptureNext = privTicks();
+  mCaptureState = capture_Armed;
+  return true;
+}
+
+void DiagTask::stopCapture()
+{
+  mCaptureState = capture_Off;
+  mCapturePeriod = 0;
+}
+
+void DiagTask::captureSample()
+{
+  if(mCaptureState != capture_Armed && mCaptureState != capture_Triggered)
+  { return; }
+
+  uint8_t * p = &mCaptureBuf[mCaptureIndex * mCaptureSampleLen];
+  for(uint8_t i = 0; i < mCaptureCount; i++)
+  {
+    const varEntry_t & v = mVariables[mCaptureVars[i]];
+    uint32_t value = privReadVariable(v);
+    for(uint8_t b = 0; b < varSize[v.type]; b++)
+    { *p++ = value >> (8 * b); }
+  }
+
+  if(++mCaptureIndex >= mCaptureSamples)
+  { mCaptureIndex = 0; }
+  if(mCaptureFilled < mCaptureSamples)
+  { mCaptureFilled++; }
+
+  if(mCaptureState == capture_Triggered && --mCaptureRemaining == 0)
+  { mCaptureState = capture_Frozen; }
+}
+
+void DiagTask::triggerCapture()
+{
+  if(mCaptureState != capture_Armed)
+  { return; }
+
+  mCaptureRemaining = mCapturePost;
+  mCaptureState = mCapturePost ? capture_Triggered : capture_Frozen;
+}
+
+void DiagTask::privDumpCapture()
+{
+  uint8_t desc[DIAGTASK_CAPTURE_MAX_VARIABLES * (DIAGTASK_MAX_HOOKNAME_LEN + 2)];
+  uint16_t n = privDescribeVariables(mCaptureVars, mCaptureCount, desc);
+  privWriteFrame(0, STREAM_FRAME_DESCRIPTION, desc, std::min(n, static_cast<uint16_t>(UINT8_MAX)));
+
+  // little endian: count, trigger position, period, ticks per second
+  uint16_t trigger = mCaptureFilled - mCapturePost;
+  uint8_t info[12] =
+  {
+    static_cast<uint8_t>(mCaptureFilled), static_cast<uint8_t>(mCaptureFilled >> 8),
+    static_cast<uint8_t>(trigger), static_cast<uint8_t>(trigger >> 8)
+  };
+  for(uint8_t b = 0; b < 4; b++)
+  {
+    info[4 + b] = mCapturePeriod >> (8 * b);
+    info[8 + b] = mTicksPerSecond >> (8 * b);
+  }
+  privWriteFrame(0, STREAM_FRAME_CAPTURE, info, sizeof(info));
+
+  // oldest sample first
+  uint16_t idx = mCaptureFilled < mCaptureSamples ? 0 : mCaptureIndex;
+  for(uint16_t i = 0; i < mCaptureFilled; i++)
+  {
+    privWriteFrame(i, STREAM_FRAME_KEY, &mCaptureBuf[idx * mCaptureSampleLen], mCaptureSampleLen);
+    if(++idx >= mCaptureSamples)
+    { idx = 0; }
+  }
+}
+
+void DiagTask::privCmdCapture(const char * input)
+{
+  static const char * const states[] = { "off", "armed", "triggered", "frozen" };
+  DiagTask * self = spInstance;
+  const char * arg;
+  uint16_t len = privNextArg(input, arg);
+  int32_t rate;
+  int32_t post;
+  uint32_t period;
+
+  if(!len)
+  {
+    self->privPrintf("%s, %u/%u samples, %u after trigger\n", states[self->mCaptureState],
+                     self->mCaptureFilled, self->mCaptureSamples, self->mCapturePost);
+  }
+  else if(len == 3 && strncmp(arg, "off", 3) == 0)
+  {
+    self->stopCapture();
+  }
+  else if(len == 4 && strncmp(arg, "trig", 4) == 0)
+  {
+    self->triggerCapture();
+  }
+  else if(len == 4 && strncmp(arg, "dump", 4) == 0)
+  {
+    if(self->mCaptureState == capture_Frozen)
+    { self->privDumpCapture(); }
+    else
+    { self->privPrintf("not frozen\n"); }
+  }
+  else if(privParseInt(arg, len, rate) && rate > 0 && !self->privSamplePeriod(rate, period))
+  {
+    self->privPrintf("invalid rate\n");
+  }
+  else if( !privParseInt(arg, len, rate) || rate < 0
+           || !privParseInt(arg, privNextArg(input, arg), post) || post < 0 || post > UINT16_MAX
+           || !self->startCapture(input, rate, post) )
+  {
+    self->privPrintf("invalid capture\n");
+  }
+}
+#endif // DIAGTASK_ENABLE_CAPTURE
+
+#if DIAGTASK_ENABLE_MEMORY
+bool DiagTask::privStartMemoryJob(const char * input, bool (DiagTask::*step)())
+{
+  const char * arg;
+  int64_t addr;
+  int64_t len;
+
+  if(mJob.step)
+  {
+    privPrintf("busy\n");
+    return false;
+  }
+
+  if( !privParseNumber(arg, privNextArg(input, arg), addr, 16)
+      || !privParseNumber(arg, privNextArg(input, arg), len) || len <= 0 || len > UINT32_MAX )
+  {
+    privPrintf("usage: <hex addr> <len>\n");
+    return false;
+  }
+
+  mJob.addr = reinterpret_cast<const uint8_t *>(static_cast<uintptr_t>(addr));
+  mJob.remaining = len;
+  mJob.value = 0;
+  mJob.patternLen = 0;
+  mJob.step = step;
+  return true;
+}
+
+uint8_t DiagTask::privFormatHexRow(char * buf, const uint8_t * addr, uint8_t len)
+{
+  // "0000000020001000: 00 01 02 .. 0f  0123456789abcdef"
+  uintptr_t a = reinterpret_cast<uintptr_t>(addr);
+  char * p = buf;
+
+  for(int8_t shift = sizeof(a) * 8 - 8; shift >= 0; shift -= 8)
+  {
+    memcpy(p, &hexPairs[2 * ((a >> shift) & 0xFF)], 2);
+    p += 2;
+  }
+  *p++ = ':';
+
+  char * ascii = p + 3 * 16 + 2;
+  for(uint8_t i = 0; i < 16; i++)
+  {
+    p[0] = ' ';
+    if(i < len)
+    {
+      uint8_t b = addr[i];
+      memcpy(&p[1], &hexPairs[2 * b], 2);
+      ascii[i] = b >= 0x20 && b < 0x7F ? b : '.';
+    }
+    else
+    {
+      p[1] = p[2] = ' ';
+    }
+    p += 3;
+  }
+  p[0] = p[1] = ' ';
+  p = ascii + len;
+  *p++ = '\n';
+
+  return p - buf;
+}
+
+bool DiagTask::privJobHexDump()
+{
+  // one row: address, 16 * 3 characters, 2 blanks, 16 characters, '\n'
+  char buf[sizeof(uintptr_t) * 2 + 1 + 16 * 3 + 2 + 16 + 1];
+
+  for(uint16_t n = 0; n < DIAGTASK_MEMORY_CHUNK && mJob.remaining; n += 16)
+  {
+    uint8_t len = std::min(mJob.remaining, static_cast<uint32_t>(16));
+    privWrite(buf, privFormatHexRow(buf, mJob.addr, len));
+    mJob.addr += len;
+    mJob.remaining -= len;
+  }
+  return mJob.remaining != 0;
+}
+
+bool DiagTask::privJobBinaryDump()
+{
+  // address is sent as 64 bit little endian value, followed by data
+  uint8_t header[8];
+  uint64_t addr = reinterpret_cast<uintptr_t>(mJob.addr);
+  uint8_t len = std::min(mJob.remaining, static_cast<uint32_t>(std::min(DIAGTASK_MEMORY_CHUNK, UINT8_MAX - 8)));
+
+  for(uint8_t b = 0; b < 8; b++)
+  { header[b] = addr >> (8 * b); }
+
+  privWriteFrame(0, STREAM_FRAME_MEMORY, header, sizeof(header), mJob.addr, len);
+  mJob.addr += len;
+  mJob.remaining -= len;
+  return mJob.remaining != 0;
+}
+
+bool DiagTask::privJobFind()
+{
+  // search chunk including bytes of a pattern that crosses end of chunk, but not end of region
+  uint32_t len = std::min(mJob.remaining, static_cast<uint32_t>(DIAGTASK_MEMORY_SCAN_CHUNK));
+  uint32_t last = std::min(len, mJob.remaining - mJob.patternLen + 1);
+  const uint8_t * p = mJob.addr;
+  const uint8_t * end = mJob.addr + last;
+
+  // memchr() of libc compares a word or vector per step
+  while(p < end && (p = static_cast<const uint8_t *>(memchr(p, mJob.pattern[0], end - p))) != NULL)
+  {
+    if(memcmp(p, mJob.pattern, mJob.patternLen) == 0)
+    {
+      privPrintf("%llx\n", static_cast<unsigned long long>(reinterpret_cast<uintptr_t>(p)));
+      mJob.value++;
+    }
+    p++;
+  }
+
+  mJob.addr += len;
+  mJob.remaining -= len;
+
+  if(mJob.remaining < mJob.patternLen)
+  {
+    privPrintf("%lu matches\n", static_cast<long unsigned int>(mJob.value));
+    return false;
+  }
+  return true;
+}
+
+bool DiagTask::privJobCrc()
+{
+  uint32_t len = std::min(mJob.remaining, static_cast<uint32_t>(DIAGTASK_MEMORY_SCAN_CHUNK));
+
+  mJob.value = privCrc32(mJob.value, mJob.addr, len);
+  mJob.addr += len;
+  mJob.remaining -= len;
+
+  if(!mJob.remaining)
+  {
+    privPrintf("crc32 %08lx\n", static_cast<long unsigned int>(mJob.value));
+    return false;
+  }
+  return true;
+}
+
+bool DiagTask::privJobSum()
+{
+  uint32_t len = std::min(mJob.remaining, static_cast<uint32_t>(DIAGTASK_MEMORY_SCAN_CHUNK));
+  uint32_t sum = mJob.value;
+
+  // simple loop that is vectorized by compiler
+  for(uint32_t i = 0; i < len; i++)
+  { sum += mJob.addr[i]; }
+
+  mJob.value = sum;
+  mJob.addr += len;
+  mJob.remaining -= len;
+
+  if(!mJob.remaining)
+  {
+    privPrintf("sum %08lx\n", static_cast<long unsigned int>(mJob.value));
+    return false;
+  }
+  return true;
+}
+
+void DiagTask::privCmdFind(const char * input)
+{
+  DiagTask * self = spInstance;
+
+  if(!self->privStartMemoryJob(input, &DiagTask::privJobFind))
+  { return; }
+
+  // pattern follows address and length as hex bytes, blanks between bytes are allowed
+  const char * arg;
+  privNextArg(input, arg);
+  privNextArg(input, arg);
+
+  uint8_t n = 0;
+  bool valid = true;
+  uint16_t len;
+  while(valid && (len = privNextArg(input, arg)) != 0)
+  {
+    for( ; len; len -= 2, arg += 2)
+    {
+      int64_t value;
+      if(len < 2 || n >= DIAGTASK_MEMORY_PATTERN_LEN || !privParseNumber(arg, 2, value, 16))
+      {
+        valid = false;
+        break;
+      }
+      self->mJob.pattern[n++] = value;
+    }
+  }
+
+  if(!valid || !n || self->mJob.remaining < n)
+  {
+    self->mJob.step = NULL;
+    self->privPrintf("invalid pattern\n");
+    return;
+  }
+  self->mJob.patternLen = n;
+}
+
+void DiagTask::privCmdCrc(const char * input)
+{
+  spInstance->privStartMemoryJob(input, &DiagTask::privJobCrc);
+}
+
+void DiagTask::privCmdSum(const char * input)
+{
+  spInstance->privStartMemoryJob(input, &DiagTask::privJobSum);
+}
+
+void DiagTask::privCmdHexDump(const char * input)
+{
+  spInstance->privStartMemoryJob(input, &DiagTask::privJobHexDump);
+}
+
+void DiagTask::privCmdBinaryDump(const char * input)
+{
+  spInstance->privStartMemoryJob(input, &DiagTask::privJobBinaryDump);
+}
+#endif // DIAGTASK_ENABLE_MEMORY
+
+#if DIAGTASK_ENABLE_UPLOAD
+// length of block is sent in one byte
+static_assert(DIAGTASK_UPLOAD_BLOCK_LEN <= UINT8_MAX, "DIAGTASK_UPLOAD_BLOCK_LEN must not exceed 255");
+
+void DiagTask::setUploadSink(const uploadSink_t & sink)
+{
+  mUploadSink = &sink;
+}
+
+void DiagTask::privProcessUpload()
+{
+  int c;
+  uint32_t now = privTicks();
+
+  // read all received bytes until one block is complete
+  while((c = mGetchar()) >= 0)
+  {
+    bool idle = (now - mUploadTime) * 10 > mTicksPerSecond;
+    mUploadTime = now;
+
+    if(!mUploadPos)
+    {
+      // ESC after a pause between blocks cancels (e.g. host died and user takes over)
+      if(c == KEY_ESC && idle)
+      {
+        privUploadEnd(false);
+        return;
+      }
+      // skip bytes until sync
+      if(c == FRAME_SYNC)
+      { mUploadPos = 1; }
+      continue;
+    }
+
+    mUploadBlock[mUploadPos++ - 1] = c;
+
+    // block does not fit into buffer; lost sync or host uses wrong block length
+    if(mUploadPos == 2 && c > DIAGTASK_UPLOAD_BLOCK_LEN)
+    {
+      mUploadPos = 0;
+      privUploadAck(upload_Nak);
+      continue;
+    }
+
+    // sync, length, sequence, type, payload, crc-32
+    if(mUploadPos > 2 && mUploadPos == 1 + 3 + mUploadBlock[0] + 4)
+    {
+      mUploadPos = 0;
+      privUploadBlock();
+      return;
+    }
+  }
+
+  // block is incomplete since 100ms; bytes were lost
+  if(mUploadPos && (now - mUploadTime) * 10 > mTicksPerSecond)
+  {
+    mUploadPos = 0;
+    privUploadAck(upload_Nak);
+  }
+
+  if(now - mUploadTime > DIAGTASK_UPLOAD_TIMEOUT * mTicksPerSecond)
+  { privUploadEnd(false); }
+}
+
+void DiagTask::privUploadBlock()
+{
+  const uint8_t len = mUploadBlock[0];
+  const uint8_t seq = mUploadBlock[1];
+  const uint8_t type = mUploadBlock[2];
+  const uint8_t * payload = &mUploadBlock[3];
+  const uint8_t * end = payload + len;
+  uint32_t crc = end[0] | end[1] << 8 | end[2] << 16 | static_cast<uint32_t>(end[3]) << 24;
+
+  if(privCrc32(0, mUploadBlock, 3 + len) != crc)
+  {
+    privUploadAck(upload_Nak);
+    return;
+  }
+
+  // cancelled by host
+  if(type == STREAM_FRAME_UPLOAD_END && !len)
+  {
+    privUploadEnd(false);
+    return;
+  }
+
+  // go-back-n: blocks behind a lost block are dropped until host sends again
+  if(seq != mUploadSeq)
+  {
+    privUploadAck(upload_Nak);
+    return;
+  }
+
+  if(type == STREAM_FRAME_UPLOAD_END)
+  {
+    // little endian size and crc-32 of file
+    uint32_t size = 0;
+    crc = 0;
+    for(uint8_t b = 0; b < 4 && len == 8; b++)
+    {
+      size |= static_cast<uint32_t>(payload[b]) << (8 * b);
+      crc |= static_cast<uint32_t>(payload[4 + b]) << (8 * b);
+    }
+    privUploadEnd(len == 8 && size == mUploadOffset && crc == mUploadCrc);
+    return;
+  }
+
+  if(type != STREAM_FRAME_UPLOAD)
+  { return; }
+
+  if(!mUploadSink->write(mUploadOffset, payload, len))
+  {
+    privUploadEnd(false);
+    return;
+  }
+
+  mUploadCrc = privCrc32(mUploadCrc, payload, len);
+  mUploadOffset += len;
+  mUploadSeq++;
+  mUploadNak = false;
+  privUploadAck(upload_Ack);
+}
+
+void DiagTask::privUploadAck(uint8_t status)
+{
+  // send only one nak until requested block was received
+  if(status == upload_Nak)
+  {
+    if(mUploadNak)
+    { return; }
+    mUploadNak = true;
+  }
+
+  uint32_t offset = status == upload_Ready ? DIAGTASK_UPLOAD_BLOCK_LEN : mUploadOffset;
+  // status and little endian offset
+  uint8_t payload[5] = { status };
+  for(uint8_t b = 0; b < 4; b++)
+  { payload[1 + b] = offset >> (8 * b); }
+  privWriteFrame(mUploadSeq, STREAM_FRAME_UPLOAD_ACK, payload, sizeof(payload));
+}
+
+void DiagTask::privUploadEnd(bool complete)
+{
+  mUploading = false;
+  privUploadAck(complete ? upload_Done : upload_Failed);
+  if(mUploadSink->close)
+  { mUploadSink->close(complete); }
+}
+
+void DiagTask::privCmdRecv(const char * input)
+{
+  DiagTask * self = spInstance;
+  const char * name;
+
+  privNextArg(input, name);
+
+  // without time, timeouts never end a broken upload
+  if(!self->mTicks && !self->mUptime)
+  {
+    self->privPrintf("upload needs tick source\n");
+    return;
+  }
+
+  if(!self->mUploadSink || !*name || !self->mUploadSink->open(name))
+  {
+    self->privPrintf("upload rejected\n");
+    return;
+  }
+
+  self->mUploading = true;
+  self->mUploadNak = false;
+  self->mUploadSeq = 0;
+  self->mUploadPos = 0;
+  self->mUploadOffset = 0;
+  self->mUploadCrc = 0;
+  self->mUploadTime = self->privTicks();
+  self->privUploadAck(upload_Ready);
+}
+#endif // DIAGTASK_ENABLE_UPLOAD
+
+#if DIAGTASK_ENABLE_DOWNLOAD
+bool DiagTask::startDownload(const void * data, uint32_t size, uint32_t start)
+{
+  if(mJob.step || !data || !size || start >= size)
+  { return false; }
+
+  mDownload.data = static_cast<const uint8_t *>(data);
+  mDownload.size = size;
+  mDownload.start = start;
+  mDownload.offset = 0;
+  mDownload.crcOffset = 0;
+  mDownload.crc = 0;
+  mJob.step = &DiagTask::privJobDownload;
+  return true;
+}
+
+uint32_t DiagTask::privDownloadSegment(uint32_t offset, uint32_t len, const uint8_t *& p)
+{
+  uint32_t idx = mDownload.start + offset;
+  if(idx >= mDownload.size)
+  { idx -= mDownload.size; }
+
+  p = mDownload.data + idx;
+  return std::min(len, std::min(mDownload.size - offset, mDownload.size - idx));
+}
+
+bool DiagTask::privJobDownload()
+{
+  download_t & d = mDownload;
+  const uint8_t * p;
+  uint32_t budget = DIAGTASK_DOWNLOAD_CHUNK;
+
+  // host is sending a command (e.g. resume); wait to avoid sending data that is discarded
+  if(mCurrentValidInput[0])
+  { return true; }
+
+  while(budget && d.offset < d.size)
+  {
+    // frame contains offset (little endian) and data
+    uint32_t len = privDownloadSegment(d.offset, std::min(budget, static_cast<uint32_t>(UINT8_MAX - 4)), p);
+    uint8_t header[4];
+    for(uint8_t b = 0; b < 4; b++)
+    { header[b] = d.offset >> (8 * b); }
+    privWriteFrame(0, STREAM_FRAME_DOWNLOAD, header, sizeof(header), p, len);
+
+    if(d.offset == d.crcOffset)
+    {
+      d.crc = privCrc32(d.crc, p, len);
+      d.crcOffset += len;
+    }
+    d.offset += len;
+    budget -= len;
+  }
+
+  if(d.offset < d.size)
+  { return true; }
+
+  // bytes that were skipped by resume are not part of crc yet
+  for(budget = DIAGTASK_MEMORY_SCAN_CHUNK; budget && d.crcOffset < d.size; )
+  {
+    uint32_t len = privDownloadSegment(d.crcOffset, budget, p);
+    d.crc = privCrc32(d.crc, p, len);
+    d.crcOffset += len;
+    budget -= len;
+  }
+
+  if(d.crcOffset < d.size)
+  { return true; }
+
+  uint8_t payload[8];
+  for(uint8_t b = 0; b < 4; b++)
+  {
+    payload[b] = d.size >> (8 * b);
+    payload[4 + b] = d.crc >> (8 * b);
+  }
+  privWriteFrame(0, STREAM_FRAME_DOWNLOAD_END, payload, sizeof(payload));
+  return false;
+}
+
+void DiagTask::privCmdDownload(const char * input)
+{
+  DiagTask * self = spInstance;
+  const char * arg;
+  uint16_t len = privNextArg(input, arg);
+  int64_t value;
+  int64_t size;
+
+  if(len == 6 && !strncmp(arg, "resume", len))
+  {
+    download_t & d = self->mDownload;
+    if( !d.data || !privParseNumber(arg, privNextArg(input, arg), value)
+        || value < 0 || value > d.size )
+    {
+      self->privPrintf("invalid offset\n");
+    }
+    else if(self->mJob.step && self->mJob.step != &DiagTask::privJobDownload)
+    {
+      self->privPrintf("busy\n");
+    }
+    else
+    {
+      d.offset = value;
+      self->mJob.step = &DiagTask::privJobDownload;
+    }
+    return;
+  }
+
+  bool started;
+#if DIAGTASK_ENABLE_TRACE
+  if(len == 5 && !strncmp(arg, "trace", len))
+  {
+    started = self->startDownload(&traceBuffer, sizeof(traceBuffer));
+  }
+  else
+#endif // DIAGTASK_ENABLE_TRACE
+#if DIAGTASK_ENABLE_CAPTURE
+  // samples in chronological order
+  if(len == 3 && !strncmp(arg, "cap", len))
+  {
+    uint16_t oldest = self->mCaptureFilled < self->mCaptureSamples ? 0 : self->mCaptureIndex;
+    started = self->startDownload( self->mCaptureBuf, self->mCaptureFilled * self->mCaptureSampleLen
+                                 , oldest * self->mCaptureSampleLen);
+  }
+  else
+#endif // DIAGTASK_ENABLE_CAPTURE
+  if( privParseNumber(arg, len, value, 16)
+      && privParseNumber(arg, privNextArg(input, arg), size) && size > 0 && size <= UINT32_MAX )
+  {
+    started = self->startDownload(reinterpret_cast<const void *>(static_cast<uintptr_t>(value)), size);
+  }
+  else
+  {
+    self->privPrintf("usage: dl <hex addr> <len>|trace|cap|resume <offset>\n");
+    return;
+  }
+
+  if(!started)
+  { self->privPrintf("busy or empty\n"); }
+}
+#endif // DIAGTASK_ENABLE_DOWNLOAD
+
+bool DiagTask::privDue(uint32_t & next, uint32_t period)
+{
+  uint32_t now = privTicks();
+  if(static_cast<int32_t>(now - next) < 0)
+  { return false; }
+
+  next += period;
+
+  // process() was called too late; do not try to catch up
+  if(static_cast<int32_t>(now - next) >= 0)
+  { next = now + period; }
+  return true;
+}
+
+void DiagTask::privWriteFrame( uint8_t seq, uint8_t type, const void * header, uint8_t headerLen
+                             , const void * data, uint8_t len)
+{
+  uint8_t frame[4] = { FRAME_SYNC, static_cast<uint8_t>(headerLen + len), seq, type };
+  uint8_t crc = privCrc8(privCrc8(0, &frame[1], 3), static_cast<const uint8_t *>(header), headerLen);
+  crc = privCrc8(crc, static_cast<const uint8_t *>(data), len);
+
+#if DIAGTASK_ENABLE_BUDGETS
+  // frames are not truncated; binary transfers have their own flow control
+  bool unlimited = mUnlimited;
+  mUnlimited = true;
+#endif // DIAGTASK_ENABLE_BUDGETS
+  privWrite(reinterpret_cast<const char *>(frame), sizeof(frame));
+  privWrite(static_cast<const char *>(header), headerLen);
+  if(len)
+  { privWrite(static_cast<const char *>(data), len); }
+  privWrite(reinterpret_cast<const char *>(&crc), 1);
+#if DIAGTASK_ENABLE_BUDGETS
+  mUnlimited = unlimited;
+#endif // DIAGTASK_ENABLE_BUDGETS
+}
+
+#if DIAGTASK_ENABLE_TRIGGERS
+bool DiagTask::addTrigger(const char * condition, const char * action)
+{
+  const char * arg;
+  hookEntry_t hook;
+
+  if( !condition || mTriggerCount >= DIAGTASK_MAX_TRIGGERS
+      || !action || strlen(action) > DIAGTASK_MAX_HOOK_INPUT_LEN || !privFindHook(action, &arg, hook) )
+  { return false; }
+
+  triggerEntry_t & t = mTriggers[mTriggerCount];
+  if(!privCompileTrigger(condition, strlen(condition), t.code))
+  { return false; }
+
+  // action is resolved once, evaluation calls the hook directly
+  strcpy(t.action, action);
+  t.hook = hook;
+  t.arg = privWildcard(hook.name) ? arg - action : strlen(action);
+  t.hits = 0;
+  t.active = false;
+  t.removed = false;
+  mTriggerCount++;
+  return true;
+}
+
+bool DiagTask::removeTrigger(uint8_t index)
+{
+  if(index >= mTriggerCount || mTriggers[index].removed)
+  { return false; }
+
+  // action of a trigger removes triggers; keep array unchanged while it is evaluated
+  if(mTriggerRunning)
+  {
+    mTriggers[index].removed = true;
+    return true;
+  }
+
+  mTriggerCount--;
+  for(uint8_t i = index; i < mTriggerCount; i++)
+  { mTriggers[i] = mTriggers[i + 1]; }
+  return true;
+}
+
+void DiagTask::evaluateTriggers()
+{
+  if(mTriggerRunning)
+  { return; }
+
+  mTriggerRunning = true;
+  for(uint8_t i = 0; i < mTriggerCount; i++)
+  {
+    triggerEntry_t & t = mTriggers[i];
+    if(t.removed)
+    { continue; }
+
+    bool active = privEvaluate(t.code) != 0;
+
+    // execute action only when condition becomes true
+    if(active && !t.active)
+    {
+      t.hits++;
+      privCallHook(t.hook, &t.action[t.arg]);
+    }
+    t.active = active;
+  }
+  mTriggerRunning = false;
+
+  // delete triggers that actions removed
+  for(uint8_t i = mTriggerCount; i-- > 0; )
+  {
+    if(mTriggers[i].removed)
+    {
+      mTriggers[i].removed = false;
+      removeTrigger(i);
+    }
+  }
+}
+
+int32_t DiagTask::privEvaluate(const uint8_t * code)
+{
+  int32_t stack[DIAGTASK_TRIGGER_STACK];
+  uint8_t sp = 0;  // stack depth was checked by compiler
+
+  for(;;)
+  {
+    uint8_t op = *code++;
+    switch(op)
+    {
+      case op_End:
+        return stack[0];
+
+      case op_Const8:
+        stack[sp++] = static_cast<int8_t>(*code++);
+        break;
+
+      case op_Const32:
+        memcpy(&stack[sp++], code, sizeof(int32_t));
+        code += sizeof(int32_t);
+        break;
+
+      case op_Var:
       {
-      // show all hooks that start with mCurrentValidInput
-      // if we only have one hook, then call hook function
+        const varEntry_t & v = mVariables[*code++];
+        stack[sp++] = v.type == var_Float ? static_cast<int32_t>(*static_cast<const float *>(v.variable))
+                                          : static_cast<int32_t>(privReadVariable(v));
+        break;
+      }
+
+      case op_Not: stack[sp - 1] = !stack[sp - 1]; break;
+      case op_Neg: stack[sp - 1] = -stack[sp - 1]; break;
+
+      default:
+      {
+        // binary operators
+        int32_t b = stack[--sp];
+        int32_t & a = stack[sp - 1];
+        switch(op)
+        {
+          case op_Or:  a = a || b; break;
+          case op_And: a = a && b; break;
+          case op_Eq:  a = a == b; break;
+          case op_Ne:  a = a != b; break;
+          case op_Lt:  a = a <  b; break;
+          case op_Le:  a = a <= b; break;
+          case op_Gt:  a = a >  b; break;
+          case op_Ge:  a = a >= b; break;
+          case op_Add: a = a +  b; break;
+          case op_Sub: a = a -  b; break;
+        }
+        break;
+      }
+    }
+  }
+}
+
+uint8_t DiagTask::privCompileTrigger(const char * condition, uint16_t len, uint8_t * code)
+{
+  triggerParser_t p;
+  p.pos = condition;
+  p.end = condition + len;
+  p.code = code;
+  p.len = 0;
+  p.depth = 0;
+  p.error = false;
+
+  privParseExpr(p, 0);
+
+  while(p.pos < p.end && *p.pos == ' ')
+  { p.pos++; }
+
+  // all characters must be used
+  if(p.pos != p.end)
+  { p.error = true; }
+
+  privEmit(p, op_End, 0);
+  return p.error ? 0 : p.len;
+}
+
+void DiagTask::privEmit(triggerParser_t & p, uint8_t op, int8_t stack, const void * arg, uint8_t len)
+{
+  p.depth += stack;
+  if(p.len + 1 + len > DIAGTASK_TRIGGER_CODE_LEN || p.depth > DIAGTASK_TRIGGER_STACK)
+  {
+    p.error = true;
+    return;
+  }
+
+  p.code[p.len++] = op;
+  if(len)
+  { memcpy(&p.code[p.len], arg, len); }
+  p.len += len;
+}
+
+void DiagTask::privParseExpr(triggerParser_t & p, uint8_t level)
+{
+  if(level >= TRIGGER_LEVELS)
+  {
+    privParseUnary(p);
+    return;
+  }
+
+  privParseExpr(p, level + 1);
+
+  while(!p.error)
+  {
+    while(p.pos < p.end && *p.pos == ' ')
+    { p.pos++; }
+
+    const triggerOperator_t * o = NULL;
+    for(const auto & t : triggerOperators)
+    {
+      uint8_t n = strlen(t.text);
+      if(t.level == level && p.end - p.pos >= n && strncmp(p.pos, t.text, n) == 0)
+      {
+        o = &t;
+        break;
+      }
+    }
+
+    if(!o)
+    { return; }
+
+    p.pos += strlen(o->text);
+    privParseExpr(p, level + 1);
+    privEmit(p, o->op, -1);
+  }
+}
+
+void DiagTask::privParseUnary(triggerParser_t & p)
+{
+  while(p.pos < p.end && *p.pos == ' ')
+  { p.pos++; }
+
+  if(p.pos >= p.end)
+  {
+    p.error = true;
+    return;
+  }
+
+  char c = *p.pos;
+
+  if(c == '!' || c == '-')
+  {
+    p.pos++;
+    privParseUnary(p);
+    privEmit(p, c == '!' ? op_Not : op_Neg, 0);
+    return;
+  }
+
+  if(c == '(')
+  {
+    p.pos++;
+    privParseExpr(p, 0);
+    while(p.pos < p.end && *p.pos == ' ')
+    { p.pos++; }
+    if(p.pos >= p.end || *p.pos != ')')
+    {
+      p.error = true;
+      return;
+    }
+    p.pos++;
+    return;
+  }
+
+  // number or variable name
+  const char * start = p.pos;
+  while(p.pos < p.end && (isalnum(static_cast<unsigned char>(*p.pos)) || strchr("_.-", *p.pos)))
+  { p.pos++; }
+
+  int32_t value;
+  if(c >= '0' && c <= '9')
+  {
+    // '-' is not part of a number
+    p.pos = start;
+    while(p.pos < p.end && isalnum(static_cast<unsigned char>(*p.pos)))
+    { p.pos++; }
+
+    if(!privParseInt(start, p.pos - start, value))
+    {
+      p.error = true;
+    }
+    else if(value >= INT8_MIN && value <= INT8_MAX)
+    {
+      int8_t v8 = value;
+      privEmit(p, op_Const8, 1, &v8, sizeof(v8));
+    }
+    else
+    {
+      privEmit(p, op_Const32, 1, &value, sizeof(value));
+    }
+    return;
+  }
+
+  // variable names may contain '-'; use longest name that is registerred
+  const varEntry_t * v = NULL;
+  while(p.pos > start && !(v = privFindVariable(start, p.pos - start)))
+  {
+    do { p.pos--; } while(p.pos > start && *p.pos != '-');
+  }
+
+  if(!v || v - &mVariables[0] > UINT8_MAX)
+  {
+    p.error = true;
+    return;
+  }
+
+  uint8_t index = v - &mVariables[0];
+  privEmit(p, op_Var, 1, &index, sizeof(index));
+}
+
+void DiagTask::privCmdTrigger(const char * input)
+{
+  DiagTask * self = spInstance;
+  const char * arg;
+  const char * start = input;
+  uint16_t len = privNextArg(input, arg);
+
+  if(!len)
+  {
+    for(uint8_t i = 0; i < self->mTriggerCount; i++)
+    {
+      const triggerEntry_t & t = self->mTriggers[i];
+      self->privPrintf("%u: %s (%u hits%s)\n", i, t.action, t.hits, t.active ? ", active" : "");
+    }
+    return;
+  }
+
+  if(len == 3 && strncmp(arg, "del", 3) == 0)
+  {
+    int32_t index;
+    len = privNextArg(input, arg);
+    if(!privParseInt(arg, len, index) || index < 0 || !self->removeTrigger(index))
+    { self->privPrintf("invalid trigger\n"); }
+    return;
+  }
+
+  // [when] <condition> then [run] <hook>
+  if(len == 4 && strncmp(arg, "when", 4) == 0)
+  { start = input; }
+
+  const char * then = strstr(start, " then ");
+  if(!then)
+  {
+    self->privPrintf("missing then\n");
+    return;
+  }
+
+  const char * action = then + 6;
+  while(*action == ' ')
+  { action++; }
+  if(strncmp(action, "run ", 4) == 0)
+  { action += 4; }
+
+  // addTrigger() needs zero terminated condition
+  char condition[DIAGTASK_MAX_HOOK_INPUT_LEN + 1];
+  len = std::min(static_cast<size_t>(then - start), sizeof(condition) - 1);
+  memcpy(condition, start, len);
+  condition[len] = '\0';
+
+  hookEntry_t hook;
+  if(!self->privFindHook(action, &arg, hook))
+  {
+    self->privPrintf("unknown hook\n");
+  }
+  else if(!self->addTrigger(condition, action))
+  {
+    self->privPrintf("invalid condition\n");
+  }
+}
+#endif // DIAGTASK_ENABLE_TRIGGERS
+
+#if DIAGTASK_ENABLE_MACROS
+bool DiagTask::addMacro(const char * name, const char * lines)
+{
+  const char * arg;
+  hookEntry_t entry;
+
+  // name of alias gets " *"
+  if( !name || !lines || strlen(name) < DIAGTASK_MIN_HOOKNAME_LEN
+      || strlen(name) + 2 > DIAGTASK_MAX_HOOKNAME_LEN || strchr(name, ' ') || privWildcard(name) )
+  { return false; }
+
+  // other hooks are not replaced
+  int8_t old = privFindMacro(name);
+  if(old < 0 && privFindHook(name, &arg, entry))
+  { return false; }
 
-        if(mFilterredHooks.size() == 1)
+  // replaced macro keeps its slot
+  int8_t index = old;
+  for(uint8_t i = 0; i < DIAGTASK_MAX_MACROS && index < 0; i++)
+  {
+    if(!mMacros[i].name[0])
+    { index = i; }
+  }
+  if(index < 0)
+  { return false; }
+
+  // looks up hooks of all lines and stores steps behind steps of other macros if store
+  // is set. returns number of steps or -1
+  uint8_t used = mMacroStepCount - (old >= 0 ? mMacros[old].count : 0);
+  hookEntry_t last;
+  auto resolve = [&](bool store) -> int16_t
+  {
+    const char * input = lines;
+    uint8_t count = 0;
+
+    while(*input)
+    {
+      char line[DIAGTASK_MAX_HOOK_INPUT_LEN + 2];
+      size_t len;
+      size_t n;
+
+      while(*input == ' ')
+      { input++; }
+      len = strcspn(input, ";");
+      for(n = len; n && input[n - 1] == ' '; n--)
+      { }
+      if(n + 1 >= sizeof(line))
+      { return -1; }
+      memcpy(line, input, n);
+      line[n] = '\0';
+      input += input[len] ? len + 1 : len;
+      if(!n)
+      { continue; }
+
+      // wildcard hook without argument (e.g. "get" for "get *")
+      if(!privFindHook(line, &arg, entry))
       {
-          printf("->%s\n", mFilterredHooks[0].name);
-          mFilterredHooks[0].hook("");
-        mCurrentValidInput[0] = '\0'; // reset input
+        strcpy(&line[n], " ");
+        if(!privFindHook(line, &arg, entry))
+        { return -1; }
       }
-      else
+
+      // line that names a macro is replaced by its steps; the replaced macro is gone then
+      if(old >= 0 && entry.macro == old + 1)
+      { return -1; }
+      uint8_t from = entry.macro ? mMacros[entry.macro - 1].first : 0;
+      uint8_t steps = entry.macro ? mMacros[entry.macro - 1].count : 1;
+      if(used + count + steps > DIAGTASK_MACRO_STEPS)
+      { return -1; }
+
+      for(uint8_t i = 0; store && i < steps; i++)
       {
-        auto len = strlen(mCurrentValidInput);
-#if ENABLE_ECHO
-        printf("\n");
-#endif // #if ENABLE_ECHO
-          for ( const auto & h: mFilterredHooks)
+        macroStep_t & step = mMacroSteps[used + count + i];
+        if(entry.macro)
         {
-          printf("[%s]%-20s\t%s\n", mCurrentValidInput, &h.name[len], h.description);
-          }
+          // argument of a line that names an alias
+          step = mMacroSteps[from + i];
+          privAppendArgument(step, arg);
+        }
+        else
+        {
+          step.hook = entry;
+          strcpy(step.arg, arg);
         }
       }
-      return true;
+      count += steps;
+      last = entry;
     }
-  #endif // DIAGTASK_ENABLE_TAB_COMPLETION
+    return count;
+  };
 
-  return false;
+  int16_t count = resolve(false);
+  if(count <= 0)
+  { return false; }
+
+  // alias of hook with argument gets input behind its name
+  char registered[DIAGTASK_MAX_HOOKNAME_LEN + 1];
+  const char * description = count == 1 ? "alias" : "macro";
+  strcpy(registered, name);
+  if(count == 1 && privWildcard(last.macro ? mMacroSteps[mMacros[last.macro - 1].first].hook.name : last.name))
+  { strcat(registered, " *"); }
+
+  // new hook is added before the replaced one is removed, so a failure keeps the old macro
+  bool rename = old < 0 || strcmp(registered, mMacros[old].name);
+  if(rename)
+  {
+    entry.hook = NULL;
+#if DIAGTASK_ENABLE_CHUNKED_HOOKS
+    entry.chunked = NULL;
+#endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+#if DIAGTASK_ENABLE_PATTERNS
+    entry.argsHook = NULL;
+#endif // DIAGTASK_ENABLE_PATTERNS
+    entry.macro = index + 1;
+    if(!privAddHook(entry, registered, description))
+    { return false; }
+  }
+
+  macroEntry_t & m = mMacros[index];
+  if(old >= 0)
+  {
+    if(rename)
+    { unregisterHook(m.name); }
+    else
+    {
+      // same name, only description may change
+      privForEachHook([&](uint16_t i, const char * hookName, uint8_t)
+      {
+        if(privNameCompare(hookName, registered, DIAGTASK_MAX_HOOKNAME_LEN + 1) != 0)
+        { return false; }
+#if DIAGTASK_HOOKDESC_LEN
+        strncpy(mHooks[i].description, description, DIAGTASK_HOOKDESC_LEN);
+        mHooks[i].description[DIAGTASK_HOOKDESC_LEN] = '\0';
+#else
+        mHooks[i].description = description;
+#endif // DIAGTASK_HOOKDESC_LEN
+        return true;
+      });
+      privInvalidateHelp();
+    }
+    privRemoveMacroSteps(old);
+  }
+
+  strcpy(m.name, registered);
+  m.first = used;
+  m.count = resolve(true);
+  mMacroStepCount = used + m.count;
+  return true;
+}
+
+bool DiagTask::removeMacro(const char * name)
+{
+  int8_t index = name ? privFindMacro(name) : -1;
+
+  if(index < 0)
+  { return false; }
+
+  unregisterHook(mMacros[index].name);
+  privRemoveMacroSteps(index);
+  mMacros[index].name[0] = '\0';
+  return true;
+}
+
+void DiagTask::privRemoveMacroSteps(uint8_t index)
+{
+  macroEntry_t & m = mMacros[index];
+
+  // steps of following macros move down
+  memmove( &mMacroSteps[m.first], &mMacroSteps[m.first + m.count]
+         , (mMacroStepCount - m.first - m.count) * sizeof(macroStep_t));
+  for(auto & other : mMacros)
+  {
+    if(other.name[0] && other.first > m.first)
+    { other.first -= m.count; }
+  }
+  mMacroStepCount -= m.count;
+  m.count = 0;
+}
+
+int8_t DiagTask::privFindMacro(const char * name)
+{
+  for(uint8_t i = 0; i < DIAGTASK_MAX_MACROS; i++)
+  {
+    // name of alias is registerred with " *"
+    size_t len = strcspn(mMacros[i].name, " ");
+    if(len && privNameCompare(mMacros[i].name, name, len) == 0 && name[len] == '\0')
+    { return i; }
+  }
+  return -1;
+}
+
+void DiagTask::privAppendArgument(macroStep_t & step, const char * input)
+{
+  size_t len = strlen(step.arg);
+
+  if(!*input)
+  { return; }
+
+  if(len && len + 1 < sizeof(step.arg))
+  { step.arg[len++] = ' '; }
+  strncpy(&step.arg[len], input, sizeof(step.arg) - 1 - len);
+  step.arg[sizeof(step.arg) - 1] = '\0';
+}
+
+void DiagTask::privRunMacro(uint8_t index, const char * input)
+{
+  // steps may change macros; use copies
+  macroEntry_t m = mMacros[index];
+
+  for(uint8_t i = 0; i < m.count; i++)
+  {
+    macroStep_t step = mMacroSteps[m.first + i];
+
+    privAppendArgument(step, input);
+    privCallHook(step.hook, step.arg);
+  }
+}
+
+void DiagTask::privCmdMacro(const char * input)
+{
+  DiagTask * self = spInstance;
+  const char * arg;
+  uint16_t len = privNextArg(input, arg);
+  const char * lines = strchr(arg, '=');
+
+  if(!len)
+  {
+    for(auto & m : self->mMacros)
+    {
+      if(!m.name[0])
+      { continue; }
+
+      self->privPrintf("%.*s =", static_cast<int>(strcspn(m.name, " ")), m.name);
+      for(uint8_t i = 0; i < m.count; i++)
+      {
+        const macroStep_t & step = self->mMacroSteps[m.first + i];
+        const char * wildcard = privWildcard(step.hook.name);
+        int n = wildcard ? wildcard - step.hook.name : strlen(step.hook.name);
+        self->privPrintf("%s %.*s%s", i ? ";" : "", n, step.hook.name, step.arg);
+      }
+      self->privPrintf("\n");
+    }
+    return;
+  }
+
+  // name without '\0' behind it is copied
+  char name[DIAGTASK_MAX_HOOKNAME_LEN + 1];
+
+  if(len == 3 && strncmp(arg, "del", 3) == 0 && !lines)
+  {
+    len = privNextArg(input, arg);
+    len = std::min(len, static_cast<uint16_t>(DIAGTASK_MAX_HOOKNAME_LEN));
+    memcpy(name, arg, len);
+    name[len] = '\0';
+    if(!self->removeMacro(name))
+    { self->privPrintf("unknown macro\n"); }
+    return;
+  }
+
+  // <name> = <line>;<line>..
+  if(!lines)
+  {
+    self->privPrintf("missing =\n");
+    return;
+  }
+
+  len = std::min(strcspn(arg, " ="), static_cast<size_t>(DIAGTASK_MAX_HOOKNAME_LEN));
+  memcpy(name, arg, len);
+  name[len] = '\0';
+  if(!self->addMacro(name, lines + 1))
+  { self->privPrintf("invalid macro\n"); }
+}
+#endif // DIAGTASK_ENABLE_MACROS
+
+uint8_t DiagTask::privCrc8(uint8_t crc, const uint8_t * data, uint16_t len)
+{
+  while(len--)
+  {
+    crc ^= *data++;
+    for(uint8_t b = 0; b < 8; b++)
+    { crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1; }
+  }
+  return crc;
+}
+
+#if DIAGTASK_ENABLE_MEMORY || DIAGTASK_ENABLE_UPLOAD || DIAGTASK_ENABLE_DOWNLOAD
+uint32_t DiagTask::privCrc32(uint32_t crc, const uint8_t * data, uint32_t len)
+{
+  crc = ~crc;
+
+#if defined(__ARM_FEATURE_CRC32)
+  for( ; len && (reinterpret_cast<uintptr_t>(data) & 3); len--)
+  { crc = __crc32b(crc, *data++); }
+  for( ; len >= 4; len -= 4, data += 4)
+  {
+    uint32_t word;
+    memcpy(&word, data, sizeof(word));
+    crc = __crc32w(crc, word);
+  }
+  for( ; len; len--)
+  { crc = __crc32b(crc, *data++); }
+
+#elif DIAGTASK_CRC32_SLICE_BY_8
+  if(!crc32Table[0][1])
+  {
+    for(uint32_t i = 0; i < 256; i++)
+    {
+      uint32_t c = i;
+      for(uint8_t b = 0; b < 8; b++)
+      { c = c & 1 ? (c >> 1) ^ 0xEDB88320 : c >> 1; }
+      crc32Table[0][i] = c;
+    }
+    for(uint32_t i = 0; i < 256; i++)
+    {
+      for(uint8_t t = 1; t < 8; t++)
+      { crc32Table[t][i] = (crc32Table[t - 1][i] >> 8) ^ crc32Table[0][crc32Table[t - 1][i] & 0xFF]; }
+    }
+  }
+
+  for( ; len >= 8; len -= 8, data += 8)
+  {
+    // little endian byte order of data
+    uint32_t lo = crc ^ (data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t>(data[3]) << 24);
+    uint32_t hi = data[4] | data[5] << 8 | data[6] << 16 | static_cast<uint32_t>(data[7]) << 24;
+    crc = crc32Table[7][lo & 0xFF] ^ crc32Table[6][(lo >> 8) & 0xFF]
+        ^ crc32Table[5][(lo >> 16) & 0xFF] ^ crc32Table[4][lo >> 24]
+        ^ crc32Table[3][hi & 0xFF] ^ crc32Table[2][(hi >> 8) & 0xFF]
+        ^ crc32Table[1][(hi >> 16) & 0xFF] ^ crc32Table[0][hi >> 24];
+  }
+  for( ; len; len--)
+  { crc = (crc >> 8) ^ crc32Table[0][(crc ^ *data++) & 0xFF]; }
+
+#else
+  for( ; len; len--)
+  {
+    crc ^= *data++;
+    crc = (crc >> 4) ^ crc32Nibbles[crc & 0x0F];
+    crc = (crc >> 4) ^ crc32Nibbles[crc & 0x0F];
+  }
+#endif
+
+  return ~crc;
+}
+#endif // DIAGTASK_ENABLE_MEMORY || DIAGTASK_ENABLE_UPLOAD || DIAGTASK_ENABLE_DOWNLOAD
+
+uint16_t DiagTask::privNextArg(const char *& input, const char *& arg)
+{
+  while(*input == ' ')
+  { input++; }
+
+  arg = input;
+  while(*input && *input != ' ')
+  { input++; }
+
+  return input - arg;
+}
+
+bool DiagTask::privParseInt(const char * str, uint16_t len, int32_t & out)
+{
+  int64_t value;
+
+  if(!privParseNumber(str, len, value) || value < INT32_MIN || value > UINT32_MAX)
+  { return false; }
+
+  out = static_cast<int32_t>(static_cast<uint32_t>(value));
+  return true;
+}
+
+bool DiagTask::privParseNumber(const char * str, uint16_t len, int64_t & out, uint8_t base)
+{
+  bool negative = false;
+  uint64_t value = 0;
+
+  if(len && *str == '-')
+  {
+    negative = true;
+    str++;
+    len--;
+  }
+
+  if(len > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X'))
+  {
+    base = 16;
+    str += 2;
+    len -= 2;
+  }
+
+  // at most 16 hexadecimal or 18 decimal digits to avoid overflow
+  if(!len || len > (base == 16 ? 16 : 18))
+  { return false; }
+
+  for( ; len; len--, str++)
+  {
+    uint64_t digit;
+    if(*str >= '0' && *str <= '9')                   { digit = *str - '0'; }
+    else if(base == 16 && *str >= 'a' && *str <= 'f') { digit = *str - 'a' + 10; }
+    else if(base == 16 && *str >= 'A' && *str <= 'F') { digit = *str - 'A' + 10; }
+    else                                             { return false; }
+    value = value * base + digit;
+  }
+
+  out = negative ? -static_cast<int64_t>(value) : static_cast<int64_t>(value);
+  return true;
+}
+
+uint8_t DiagTask::privFormatUnsigned(char * buf, uint32_t value)
+{
+  char tmp[10];
+  uint8_t n = 0;
+
+  do
+  {
+    tmp[n++] = '0' + value % 10;
+    value /= 10;
+  } while(value);
+
+  for(uint8_t i = 0; i < n; i++)
+  { buf[i] = tmp[n - 1 - i]; }
+
+  return n;
+}
+
+uint8_t DiagTask::privFormatInteger(char * buf, uint64_t value, uint8_t base, bool upper)
+{
+  const char * digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  char tmp[22];
+  uint8_t n = 0;
+
+  do
+  {
+    tmp[n++] = digits[value % base];
+    value /= base;
+  } while(value);
+
+  for(uint8_t i = 0; i < n; i++)
+  { buf[i] = tmp[n - 1 - i]; }
+
+  return n;
+}
+
+uint8_t DiagTask::privFormatSigned(char * buf, int32_t value)
+{
+  if(value < 0)
+  {
+    buf[0] = '-';
+    return 1 + privFormatUnsigned(&buf[1], 0u - static_cast<uint32_t>(value));
+  }
+  return privFormatUnsigned(buf, value);
+}
+
+// rounds value * 10^digits to the nearest integer, ties to even like printf()
+static uint64_t roundScaled(double value, uint8_t digits)
+{
+  for(uint8_t i = 0; i < digits; i++)
+  { value *= 10; }
+
+  uint64_t integer = static_cast<uint64_t>(value);
+  double rest = value - static_cast<double>(integer);
+  if(rest > 0.5 || (rest == 0.5 && (integer & 1)))
+  { integer++; }
+  return integer;
+}
+
+uint8_t DiagTask::privFormatDouble(char * buf, double value, uint8_t digits, char conversion)
+{
+  static const double powers[] = { 1e256, 1e128, 1e64, 1e32, 1e16, 1e8, 1e4, 1e2, 1e1 };
+  bool upper = conversion >= 'A' && conversion <= 'Z';
+  conversion |= 0x20;
+  uint8_t n = 0;
+  uint64_t raw;
+
+  // sign bit, so -0.0 is printed with sign like printf() does
+  memcpy(&raw, &value, sizeof(raw));
+  if(raw >> 63)
+  {
+    buf[n++] = '-';
+    value = -value;
+  }
+
+  if(value != value)
+  {
+    memcpy(&buf[n], upper ? "NAN" : "nan", 3);
+    return n + 3;
+  }
+
+  if(value > 1.7976931348623157e308)
+  {
+    memcpy(&buf[n], upper ? "INF" : "inf", 3);
+    return n + 3;
+  }
+
+  // integer part must fit into 64 bit, larger values are printed with exponent
+  if(conversion == 'f' && value >= 1e19)
+  { conversion = 'e'; }
+
+  // mantissa in [1, 10) and decimal exponent of value
+  double mantissa = value;
+  int16_t exponent = 0;
+  if(mantissa != 0)
+  {
+    for(uint8_t i = 0; i < sizeof(powers) / sizeof(powers[0]); i++)
+    {
+      if(mantissa >= powers[i])
+      {
+        mantissa /= powers[i];
+        exponent += 256 >> i;
+      }
+    }
+    for(uint8_t i = 0; i < sizeof(powers) / sizeof(powers[0]); i++)
+    {
+      if(mantissa * powers[i] < 10)
+      {
+        mantissa *= powers[i];
+        exponent -= 256 >> i;
+      }
+    }
+  }
+
+  // %g: precision is number of significant digits. style depends on the exponent
+  // after rounding, trailing zeros are removed
+  bool strip = false;
+  if(conversion == 'g')
+  {
+    digits = digits ? digits - 1 : 0;
+    int16_t rounded = exponent;
+    uint64_t limit = 1;
+    for(uint8_t i = 0; i <= digits; i++)
+    { limit *= 10; }
+    if(roundScaled(mantissa, digits) >= limit)
+    { rounded++; }
+
+    if(rounded >= -4 && rounded <= digits)
+    {
+      conversion = 'f';
+      digits = std::min(digits - rounded, 17);
+    }
+    else
+    { conversion = 'e'; }
+    strip = true;
+  }
+
+  uint64_t integer;
+  uint64_t fraction;
+  uint64_t scale = 1;
+  for(uint8_t i = 0; i < digits; i++)
+  { scale *= 10; }
+
+  if(conversion == 'f')
+  {
+    integer = static_cast<uint64_t>(value);
+    double rest = value - static_cast<double>(integer);
+    fraction = roundScaled(rest, digits);
+    if(digits == 0 && rest == 0.5 && (integer & 1))
+    { fraction = 1; } // tie to even integer part
+  }
+  else
+  {
+    fraction = roundScaled(mantissa, digits);
+    integer = fraction / scale;
+    fraction %= scale;
+    if(integer >= 10)
+    { // rounding overflow, e.g. 9.99 -> 10.0
+      integer = 1;
+      exponent++;
+    }
+  }
+  if(fraction >= scale)
+  { // rounding overflow
+    integer++;
+    fraction -= scale;
+  }
+
+  n += privFormatInteger(&buf[n], integer, 10, false);
+  if(strip)
+  {
+    for( ; digits && fraction % 10 == 0; digits--)
+    { fraction /= 10; }
+    scale = 1;
+    for(uint8_t i = 0; i < digits; i++)
+    { scale *= 10; }
+  }
+  if(digits)
+  {
+    buf[n++] = '.';
+    for(uint64_t d = scale / 10; d; d /= 10)
+    { buf[n++] = '0' + (fraction / d) % 10; }
+  }
+
+  if(conversion == 'e')
+  {
+    buf[n++] = upper ? 'E' : 'e';
+    buf[n++] = exponent < 0 ? '-' : '+';
+    exponent = exponent < 0 ? -exponent : exponent;
+    if(exponent < 10)
+    { buf[n++] = '0'; }
+    n += privFormatUnsigned(&buf[n], exponent);
+  }
+
+  return n;
 }
 
+uint8_t DiagTask::privFormatFloat(char * buf, float value, uint8_t digits)
+{
+  uint8_t n = 0;
+
+  if(value != value)
+  {
+    memcpy(buf, "nan", 3);
+    return 3;
+  }
+
+  if(value < 0)
+  {
+    buf[n++] = '-';
+    value = -value;
+  }
+
+  if(value > 3.4e38f)
+  {
+    memcpy(&buf[n], "inf", 3);
+    return n + 3;
+  }
+
+  // large values are printed with exponent
+  int8_t exponent = 0;
+  if(value >= 1e9f)
+  {
+    while(value >= 10.0f)
+    {
+      value /= 10.0f;
+      exponent++;
+    }
+  }
+
+  uint32_t scale = 1;
+  for(uint8_t i = 0; i < digits; i++)
+  { scale *= 10; }
+
+  uint32_t integer = static_cast<uint32_t>(value);
+  uint32_t fraction = static_cast<uint32_t>((value - integer) * scale + 0.5f);
+  if(fraction >= scale)
+  { // rounding overflow
+    integer++;
+    fraction -= scale;
+  }
+
+  n += privFormatUnsigned(&buf[n], integer);
+  if(digits)
+  {
+    buf[n++] = '.';
+    for(uint32_t d = scale / 10; d; d /= 10)
+    {
+      buf[n++] = '0' + (fraction / d) % 10;
+    }
+  }
+
+  if(exponent)
+  {
+    buf[n++] = 'e';
+    n += privFormatUnsigned(&buf[n], exponent);
+  }
+
+  return n;
+}
 
 #if DIAGTASK_ENABLE_HELP
 void DiagTask::privHelp()
 {
-  printf("\n");
+#if DIAGTASK_HELP_CACHE_LEN
+  if(!mHelpLen)
+  { mHelpLen = privRenderHelp(mHelpCache, sizeof(mHelpCache)); }
+
+  if(mHelpLen < sizeof(mHelpCache))
+  {
+    privWrite(mHelpCache, mHelpLen);
+    return;
+  }
+  // help does not fit into cache
+#endif // DIAGTASK_HELP_CACHE_LEN
+
+  privRenderHelp(NULL, 0);
+}
+
+uint16_t DiagTask::privRenderHelp(char * buf, uint16_t size)
+{
+  char line[DIAGTASK_PRINT_BUFFER_LEN];
+  char description[DIAGTASK_PRINT_BUFFER_LEN];
+  uint16_t len = 0;
+
+  // appends text to buf or writes it
+  auto put = [&](const char * text, uint16_t n)
+  {
+    if(!buf)
+    { privWrite(text, n); }
+    else if(len + n < size)
+    {
+      memcpy(&buf[len], text, n);
+      len += n;
+    }
+    else
+    { len = size; }
+  };
+  auto emit = [&](uint16_t n) { put(line, n); };
+
+  emit(format(line, sizeof(line), "\n"));
 
 #if DIAGTASK_ENABLE_HELP
-  printf("%c - help\n", SPECIAL_KEYWORD_HELP);
+  emit(format(line, sizeof(line), "%c - help\n", SPECIAL_KEYWORD_HELP));
 #endif //DIAGTASK_ENABLE_HELP
 
 #if DIAGTASK_ENABLE_SEARCH
-  printf("%c - search\n", SPECIAL_KEYWORD_SEARCH);
+  emit(format(line, sizeof(line), "%c - search\n", SPECIAL_KEYWORD_SEARCH));
 #endif //DIAGTASK_ENABLE_SEARCH
 
 #if DIAGTASK_ENABLE_SEPARATOR
-  printf("%c - separator\n", SPECIAL_KEYWORD_SEPARATOR);
+  emit(format(line, sizeof(line), "%c - separator\n", SPECIAL_KEYWORD_SEPARATOR));
 #endif //DIAGTASK_ENABLE_SEPARATOR
 
 #if DIAGTASK_ENABLE_REBOOT
-  printf("%c - reboot\n", SPECIAL_KEYWORD_REBOOT);
+  emit(format(line, sizeof(line), "%c - reboot\n", SPECIAL_KEYWORD_REBOOT));
 #endif //DIAGTASK_ENABLE_REBOOT
 
-  for (const auto & h : mHooks)
+  int width = privHelpWidth();
+  privForEachHook([&](uint16_t i, const char * name, uint8_t)
   {
-    printf("%-20s\t%s\n", h.name, h.description);
-  }
+    // description is written on its own, so long descriptions are not truncated by line
+    const char * text = privDescription(mHooks[i], name, description, sizeof(description));
+    emit(format(line, sizeof(line), "%-*s\t", width, name));
+    put(text, strlen(text));
+    put("\n", 1);
+    return false;
+  });
+
+  return len;
 }
 #endif // DIAGTASK_ENABLE_HELP
 
@@ -421,11 +4934,11 @@ void DiagTask::privDisplaySeparator()
 {
  static uint32_t count=0;
 
-  printf("\n\n\n\n");
-  printf("###########################################\n");
-  printf("### SEPARATOR %5lu ######  %10lu  ###\n", static_cast<long unsigned int>(count), static_cast<long unsigned int>(mUptime ? mUptime() : 0));
-  printf("###########################################\n");
-  printf("\n\n\n\n");
+  privPrintf("\n\n\n\n");
+  privPrintf("###########################################\n");
+  privPrintf("### SEPARATOR %5lu ######  %10lu  ###\n", static_cast<long unsigned int>(count), static_cast<long unsigned int>(mUptime ? mUptime() : 0));
+  privPrintf("###########################################\n");
+  privPrintf("\n\n\n\n");
   count++;
 }
 
@@ -79,6 +79,104 @@ POSSIBILITY OF SUCH DAMAGE.
   #define DIAGTASK_ENABLE_TAB_COMPLETION      1
 #endif
 
+#ifndef DIAGTASK_ENABLE_LOG
+  /// @brief Enables the log channel (see DiagTask::log()). Messages are stored unformatted
+  ///        in a lock-free ring buffer and are formatted by process().
+  #define DIAGTASK_ENABLE_LOG                 0
+#endif
+
+#ifndef DIAGTASK_ENABLE_TRACE
+  /// @brief Enables the trace buffer that records hook calls, commands and log messages.
+  ///        The buffer is placed in RAM that is not initialized at reset, so the trace
+  ///        of the previous boot can be printed after a reboot or watchdog reset.
+  #define DIAGTASK_ENABLE_TRACE               0
+#endif
+
+#ifndef DIAGTASK_ENABLE_METRICS
+  /// @brief Enables named counters, gauges and timers (see DiagTask::registerMetric())
+  #define DIAGTASK_ENABLE_METRICS             0
+#endif
+
+#ifndef DIAGTASK_ENABLE_VARIABLES
+  /// @brief Enables registration of variables that can be read and written via
+  ///        console commands "get", "set" and "vars" (see DiagTask::registerVariable())
+  #define DIAGTASK_ENABLE_VARIABLES           0
+#endif
+
+#ifndef DIAGTASK_ENABLE_STREAM
+  /// @brief Enables binary streaming of registerred variables (requires DIAGTASK_ENABLE_VARIABLES)
+  #define DIAGTASK_ENABLE_STREAM              0
+#endif
+
+#ifndef DIAGTASK_ENABLE_TRIGGERS
+  /// @brief Enables triggers that call a hook when a condition on registerred variables
+  ///        becomes true (requires DIAGTASK_ENABLE_VARIABLES)
+  #define DIAGTASK_ENABLE_TRIGGERS            0
+#endif
+
+#ifndef DIAGTASK_ENABLE_CAPTURE
+  /// @brief Enables capturing of registerred variables into a ring buffer that is frozen
+  ///        after a trigger (requires DIAGTASK_ENABLE_VARIABLES)
+  #define DIAGTASK_ENABLE_CAPTURE             0
+#endif
+
+#ifndef DIAGTASK_ENABLE_MEMORY
+  /// @brief Enables memory commands ("md" hex dump, "mdb" binary dump, "find", "crc", "sum")
+  #define DIAGTASK_ENABLE_MEMORY              0
+#endif
+
+#ifndef DIAGTASK_ENABLE_CHUNKED_HOOKS
+  /// @brief Enables hooks that receive their argument in chunks (unlimited argument length)
+  #define DIAGTASK_ENABLE_CHUNKED_HOOKS       0
+#endif
+
+#ifndef DIAGTASK_ENABLE_UPLOAD
+  /// @brief Enables binary upload of files into a sink ("recv")
+  #define DIAGTASK_ENABLE_UPLOAD              0
+#endif
+
+#ifndef DIAGTASK_ENABLE_DOWNLOAD
+  /// @brief Enables resumable binary download of memory, trace and capture buffer ("dl")
+  #define DIAGTASK_ENABLE_DOWNLOAD            0
+#endif
+
+#ifndef DIAGTASK_ENABLE_COMPRESSION
+  /// @brief Enables lzss compression of all output ("compress on")
+  #define DIAGTASK_ENABLE_COMPRESSION         0
+#endif
+
+#ifndef DIAGTASK_ENABLE_SINKS
+  /// @brief Enables output to multiple sinks through a shared ring buffer
+  #define DIAGTASK_ENABLE_SINKS               0
+#endif
+
+#ifndef DIAGTASK_ENABLE_BUDGETS
+  /// @brief Enables output budgets (bytes per second) for all output and for single hooks
+  #define DIAGTASK_ENABLE_BUDGETS             0
+#endif
+
+#ifndef DIAGTASK_ENABLE_IGNORE_CASE
+  /// @brief Hook names are matched case-insensitive. Names are stored in lower case.
+  #define DIAGTASK_ENABLE_IGNORE_CASE         0
+#endif
+
+#ifndef DIAGTASK_ENABLE_ABBREVIATIONS
+  /// @brief Hooks can be selected by abbreviating each segment of the name followed by
+  ///        '\n' (e.g. "n-s" for "net-stats")
+  #define DIAGTASK_ENABLE_ABBREVIATIONS       0
+#endif
+
+#ifndef DIAGTASK_ENABLE_PATTERNS
+  /// @brief Enables hooks with several placeholders ("*" or "<name>") that receive the
+  ///        matched words as argc/argv (see registerPatternHook())
+  #define DIAGTASK_ENABLE_PATTERNS            0
+#endif
+
+#ifndef DIAGTASK_ENABLE_MACROS
+  /// @brief Enables aliases and macros that call other hooks ("alias", "macro")
+  #define DIAGTASK_ENABLE_MACROS              0
+#endif
+
 // following read functions are blocking and can cause system watchdog events or
 // stop main loop.
 #ifndef DIAGTASK_ENABLE_READ_KEY
@@ -121,16 +219,306 @@ POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #ifndef DIAGTASK_HOOKDESC_LEN
-  /// @brief defines the maximal hook description  length (static array)
+  /// @brief defines the maximal hook description  length (static array). With 0, descriptions
+  ///        are not copied and only a pointer is stored (e.g. to a string literal in flash).
   #define DIAGTASK_HOOKDESC_LEN           20
 #endif
 
+#ifndef DIAGTASK_NAME_POOL_LEN
+  /// @brief defines the size of a pool that holds all hook names sorted and front-coded
+  ///        (each name stores only the characters that differ from the previous name).
+  ///        0 stores names in a static array of each hook.
+  #define DIAGTASK_NAME_POOL_LEN          0
+#endif
+
+#ifndef DIAGTASK_HOOK_KEY_LEN
+  /// @brief defines the number of leading name characters of each hook that are stored in a
+  ///        packed key array. Input is compared with 16 keys at once (SSE2, NEON or scalar),
+  ///        only matching hooks are compared completely. 0 disables keys. Not used with
+  ///        DIAGTASK_NAME_POOL_LEN.
+  #if defined(__linux__) && (defined(__SSE2__) || defined(__ARM_NEON))
+    #define DIAGTASK_HOOK_KEY_LEN         8
+  #else
+    #define DIAGTASK_HOOK_KEY_LEN         0
+  #endif
+#endif
+
+#ifndef DIAGTASK_HELP_CACHE_LEN
+  /// @brief defines the size of the buffer that holds the rendered help text. The text is
+  ///        rendered once and rebuilt after hooks changed. 0 formats help on each request.
+  #define DIAGTASK_HELP_CACHE_LEN         0
+#endif
+
+#ifndef DIAGTASK_MAX_PATTERN_ARGS
+  /// @brief defines the maximal number of placeholders of a pattern hook
+  #define DIAGTASK_MAX_PATTERN_ARGS       8
+#endif
+
 #ifndef DIAGTASK_MAX_HOOKS
   /// @brief defines the maximal number of hooks. currently only used when using ETL library
   #define DIAGTASK_MAX_HOOKS              20
 #endif
 
+#ifndef DIAGTASK_PRINT_BUFFER_LEN
+  /// @brief defines the size of the stack buffer that is used to format one output line
+  #define DIAGTASK_PRINT_BUFFER_LEN       80
+#endif
+
+#ifndef DIAGTASK_LOG_ENTRIES
+  /// @brief defines the number of entries of the log ring buffer. Must be a power of two.
+  #define DIAGTASK_LOG_ENTRIES            32
+#endif
+
+#ifndef DIAGTASK_LOG_MAX_ARGS
+  /// @brief defines the maximal number of arguments stored per log entry. Additional
+  ///        arguments are ignored.
+  #define DIAGTASK_LOG_MAX_ARGS           4
+#endif
+
+#ifndef DIAGTASK_LOG_MAX_MODULES
+  /// @brief defines the maximal number of log modules. currently only used when using ETL library
+  #define DIAGTASK_LOG_MAX_MODULES        10
+#endif
+
+/// @defgroup log_levels Log levels used by DIAGTASK_LOG()
+/// @{
+#define DIAGTASK_LOG_OFF                  0
+#define DIAGTASK_LOG_ERROR                1
+#define DIAGTASK_LOG_WARNING              2
+#define DIAGTASK_LOG_INFO                 3
+#define DIAGTASK_LOG_DEBUG                4
+#define DIAGTASK_LOG_VERBOSE              5
+/// @}
+
+#ifndef DIAGTASK_LOG_BUILD_LEVEL
+  /// @brief messages with a higher log level than this are removed at compile time
+  #define DIAGTASK_LOG_BUILD_LEVEL        DIAGTASK_LOG_DEBUG
+#endif
+
+#ifndef DIAGTASK_LOG_DRAIN_PER_PROCESS
+  /// @brief defines the maximal number of log entries that are formatted per call of process()
+  #define DIAGTASK_LOG_DRAIN_PER_PROCESS  4
+#endif
+
+#ifndef DIAGTASK_TRACE_ENTRIES
+  /// @brief defines the number of entries of the trace buffer. Must be a power of two.
+  #define DIAGTASK_TRACE_ENTRIES          64
+#endif
+
+#ifndef DIAGTASK_TRACE_ATTRIBUTE
+  /// @brief attribute that places the trace buffer in a section that is not zeroed
+  ///        at reset (linker script must provide this section)
+  #if defined(__GNUC__) && !defined(__linux__)
+    #define DIAGTASK_TRACE_ATTRIBUTE      __attribute__((section(".noinit")))
+  #else
+    #define DIAGTASK_TRACE_ATTRIBUTE
+  #endif
+#endif
+
+#ifndef DIAGTASK_BUILD_ID
+  /// @brief identifies the firmware image in the trace buffer, e.g. image crc or commit hash.
+  ///        Log messages of a previous boot are only printed if it ran the same image;
+  ///        otherwise the address of their format string is printed. Combined with compile
+  ///        time and a read-only data address of diagtask.cpp.
+  #define DIAGTASK_BUILD_ID               0
+#endif
+
+#ifndef DIAGTASK_CHUNKED_HOOK_BUFFER
+  /// @brief defines the maximal number of characters that are passed to data() of a
+  ///        chunked hook per call of process() (buffer on stack)
+  #define DIAGTASK_CHUNKED_HOOK_BUFFER    32
+#endif
+
+#ifndef DIAGTASK_UPLOAD_BLOCK_LEN
+  /// @brief defines the maximal payload of one upload block (max. 255, RAM of receive buffer)
+  #define DIAGTASK_UPLOAD_BLOCK_LEN       128
+#endif
+
+#ifndef DIAGTASK_UPLOAD_TIMEOUT
+  /// @brief defines the time in seconds after which an upload is aborted if no byte is received
+  #define DIAGTASK_UPLOAD_TIMEOUT         5
+#endif
+
+#ifndef DIAGTASK_DOWNLOAD_CHUNK
+  /// @brief defines the number of bytes sent per call of process() during a download
+  #define DIAGTASK_DOWNLOAD_CHUNK         1024
+#endif
+
+#ifndef DIAGTASK_COMPRESS_WINDOW_BITS
+  /// @brief defines the size of the compression window (2^bits bytes of RAM, 8..12).
+  ///        Matches are up to 2^(16 - bits) + 1 bytes long.
+  #define DIAGTASK_COMPRESS_WINDOW_BITS   8
+#endif
+
+#ifndef DIAGTASK_MAX_SINKS
+  /// @brief defines the maximal number of output sinks
+  #define DIAGTASK_MAX_SINKS              4
+#endif
+
+#ifndef DIAGTASK_SINK_RING_LEN
+  /// @brief defines the size of the output ring shared by all sinks (power of 2)
+  #define DIAGTASK_SINK_RING_LEN          2048
+#endif
+
+#ifndef DIAGTASK_MAX_HOOK_BUDGETS
+  /// @brief defines the maximal number of hooks with an output budget
+  #define DIAGTASK_MAX_HOOK_BUDGETS       4
+#endif
+
+#ifndef DIAGTASK_BUDGET_MARKER
+  /// @brief text that is written when output is truncated because budget is exhausted
+  #define DIAGTASK_BUDGET_MARKER          "~\n"
+#endif
+
+#ifndef DIAGTASK_MAX_METRICS
+  /// @brief defines the maximal number of metrics. currently only used when using ETL library
+  #define DIAGTASK_MAX_METRICS            20
+#endif
+
+#ifndef DIAGTASK_METRIC_SHARDS
+  /// @brief defines the number of shards per counter. Threads increment different shards
+  ///        to avoid cache line contention.
+  #if defined(__linux__)
+    #define DIAGTASK_METRIC_SHARDS        8
+  #else
+    #define DIAGTASK_METRIC_SHARDS        1
+  #endif
+#endif
+
+#ifndef DIAGTASK_METRIC_ALIGN
+  /// @brief alignment of one counter shard (cache line size)
+  #if DIAGTASK_METRIC_SHARDS > 1
+    #define DIAGTASK_METRIC_ALIGN         64
+  #else
+    #define DIAGTASK_METRIC_ALIGN         4
+  #endif
+#endif
+
+#ifndef DIAGTASK_MAX_VARIABLES
+  /// @brief defines the maximal number of variables. currently only used when using ETL library
+  #define DIAGTASK_MAX_VARIABLES          20
+#endif
+
+#ifndef DIAGTASK_VARIABLE_FLOAT_DIGITS
+  /// @brief defines the number of fractional digits printed for float variables
+  #define DIAGTASK_VARIABLE_FLOAT_DIGITS  3
+#endif
+
+#ifndef DIAGTASK_STREAM_MAX_VARIABLES
+  /// @brief defines the maximal number of variables in one stream sample
+  #define DIAGTASK_STREAM_MAX_VARIABLES   8
+#endif
+
+#ifndef DIAGTASK_STREAM_BUFFER_LEN
+  /// @brief defines the size of the buffer holding samples until process() writes them
+  #define DIAGTASK_STREAM_BUFFER_LEN      256
+#endif
+
+#ifndef DIAGTASK_STREAM_KEYFRAME
+  /// @brief defines the number of samples after which a complete sample is sent in
+  ///        delta mode
+  #define DIAGTASK_STREAM_KEYFRAME        32
+#endif
+
+#ifndef DIAGTASK_MAX_TRIGGERS
+  /// @brief defines the maximal number of triggers (static array)
+  #define DIAGTASK_MAX_TRIGGERS           4
+#endif
+
+#ifndef DIAGTASK_TRIGGER_CODE_LEN
+  /// @brief defines the maximal length of the compiled condition of one trigger in bytes
+  #define DIAGTASK_TRIGGER_CODE_LEN       32
+#endif
+
+#ifndef DIAGTASK_TRIGGER_STACK
+  /// @brief defines the maximal stack depth used to evaluate a condition
+  #define DIAGTASK_TRIGGER_STACK          8
+#endif
+
+#ifndef DIAGTASK_MAX_MACROS
+  /// @brief defines the maximal number of aliases and macros (static array)
+  #define DIAGTASK_MAX_MACROS             4
+#endif
+
+#ifndef DIAGTASK_MACRO_STEPS
+  /// @brief defines the number of hook calls of all macros together (static array)
+  #define DIAGTASK_MACRO_STEPS            16
+#endif
+
+#ifndef DIAGTASK_CAPTURE_BUFFER_LEN
+  /// @brief defines the size of the capture ring buffer in bytes (static array)
+  #define DIAGTASK_CAPTURE_BUFFER_LEN     1024
+#endif
+
+#ifndef DIAGTASK_CAPTURE_MAX_VARIABLES
+  /// @brief defines the maximal number of variables in one capture sample
+  #define DIAGTASK_CAPTURE_MAX_VARIABLES  8
+#endif
+
+#ifndef DIAGTASK_MEMORY_CHUNK
+  /// @brief defines the number of bytes processed by memory commands per call of process()
+  #define DIAGTASK_MEMORY_CHUNK           64
+#endif
+
+#ifndef DIAGTASK_MEMORY_SCAN_CHUNK
+  /// @brief defines the number of bytes searched or checksummed per call of process()
+  #define DIAGTASK_MEMORY_SCAN_CHUNK      4096
+#endif
+
+#ifndef DIAGTASK_MEMORY_PATTERN_LEN
+  /// @brief defines the maximal length of a search pattern of "find"
+  #define DIAGTASK_MEMORY_PATTERN_LEN     16
+#endif
+
+#ifndef DIAGTASK_CRC32_SLICE_BY_8
+  /// @brief crc32 uses 8 tables (8 KB RAM) to process 8 bytes per step. Otherwise a
+  ///        table of 16 entries is used. Not used when CPU supports crc32 instructions.
+  #if defined(__linux__)
+    #define DIAGTASK_CRC32_SLICE_BY_8     1
+  #else
+    #define DIAGTASK_CRC32_SLICE_BY_8     0
+  #endif
+#endif
+
+#include <stdarg.h>
 #include <stdint.h>
+#include <string.h>
+
+#if DIAGTASK_ENABLE_STREAM && !DIAGTASK_ENABLE_VARIABLES
+  #error "DIAGTASK_ENABLE_STREAM requires DIAGTASK_ENABLE_VARIABLES"
+#endif
+
+#if DIAGTASK_ENABLE_TRIGGERS && !DIAGTASK_ENABLE_VARIABLES
+  #error "DIAGTASK_ENABLE_TRIGGERS requires DIAGTASK_ENABLE_VARIABLES"
+#endif
+
+#if DIAGTASK_ENABLE_CAPTURE && !DIAGTASK_ENABLE_VARIABLES
+  #error "DIAGTASK_ENABLE_CAPTURE requires DIAGTASK_ENABLE_VARIABLES"
+#endif
+
+#if DIAGTASK_ENABLE_LOG || DIAGTASK_ENABLE_TRACE || DIAGTASK_ENABLE_METRICS || DIAGTASK_ENABLE_STREAM
+  #include <atomic>
+#endif
+
+#if DIAGTASK_ENABLE_LOG
+  #include <type_traits>
+
+  /** @brief logs a message if level is enabled for module
+   *
+   * Messages above DIAGTASK_LOG_BUILD_LEVEL are removed at compile time. All other messages
+   * cost one load and compare, if the level is disabled at runtime (see "log-level" command).
+   * @param diagtask DiagTask instance
+   * @param module   DiagTask::logModule_t of the caller
+   * @param level    one of DIAGTASK_LOG_ERROR .. DIAGTASK_LOG_VERBOSE
+   * @param ...      format string and arguments (see DiagTask::log())
+   */
+  #define DIAGTASK_LOG(diagtask, module, level, ...)                        \
+    do                                                                      \
+    {                                                                       \
+      if( (level) <= DIAGTASK_LOG_BUILD_LEVEL && (module).enabled(level) )  \
+      { (diagtask).log((module), (level), __VA_ARGS__); }                   \
+    } while(0)
+#endif
 
 #if DIAGTASK_USE_ETL
   #include <etl/vector.h>
@@ -150,37 +538,602 @@ class DiagTask
       feature_Seperator     = 0x02,
       feature_Search        = 0x04,
       feature_Reboot        = 0x08,
-      feature_TabCompletion = 0x10
+      feature_TabCompletion = 0x10,
+      feature_Log           = 0x20,
+      feature_Trace         = 0x40,
+      feature_Metrics       = 0x80,
+      feature_Variables     = 0x100,
+      feature_Stream        = 0x200,
+      feature_Triggers      = 0x400,
+      feature_Capture       = 0x800,
+      feature_Memory        = 0x1000,
+      feature_Upload        = 0x2000,
+      feature_Download      = 0x4000,
+      feature_Compression   = 0x8000,
+      feature_Sinks         = 0x10000,
+      feature_Macros        = 0x20000
+    };
+
+#if DIAGTASK_ENABLE_LOG
+    /// @brief log module with its own log level threshold. Must be registerred via
+    ///        registerLogModule() and must exist as long as DiagTask exists.
+    class logModule_t
+    {
+      public:
+        /// @param name  name of module (string is not copied)
+        /// @param level initial log level
+        explicit logModule_t(const char * name, uint8_t level = DIAGTASK_LOG_INFO)
+          : mName(name), mLevel(level)
+        {}
+
+        /// @brief returns true if messages with this level should be logged
+        bool enabled(uint8_t level) const
+        { return level <= mLevel.load(std::memory_order_relaxed); }
+
+        /// @cond
+        const char *         mName;
+        std::atomic<uint8_t> mLevel;
+        /// @endcond
+    };
+#endif // DIAGTASK_ENABLE_LOG
+
+#if DIAGTASK_ENABLE_METRICS
+    /// @brief counter that can be incremented wait-free from any thread or interrupt
+    class counter_t
+    {
+      public:
+        counter_t()
+        { reset(); }
+
+        /// @brief increments counter
+        void inc(uint32_t n = 1)
+        { mShards[privShard()].value.fetch_add(n, std::memory_order_relaxed); }
+
+        /// @brief returns sum of all shards
+        uint32_t value() const
+        {
+          uint32_t sum = 0;
+          for(const auto & s : mShards)
+          { sum += s.value.load(std::memory_order_relaxed); }
+          return sum;
+        }
+
+        /// @brief sets counter to zero
+        void reset()
+        {
+          for(auto & s : mShards)
+          { s.value.store(0, std::memory_order_relaxed); }
+        }
+
+      private:
+        /// @cond
+        friend class DiagTask;
+
+        struct alignas(DIAGTASK_METRIC_ALIGN) shard_t
+        {
+          std::atomic<uint32_t> value;
+        };
+        shard_t mShards[DIAGTASK_METRIC_SHARDS];
+        /// @endcond
+    };
+
+    /// @brief gauge that holds the last value set
+    class gauge_t
+    {
+      public:
+        gauge_t() : mValue(0)
+        {}
+
+        /// @brief sets value
+        void set(int32_t value)
+        { mValue.store(value, std::memory_order_relaxed); }
+
+        /// @brief adds delta (may be negative) to value
+        void add(int32_t delta)
+        { mValue.fetch_add(delta, std::memory_order_relaxed); }
+
+        /// @brief returns current value
+        int32_t value() const
+        { return mValue.load(std::memory_order_relaxed); }
+
+      private:
+        /// @cond
+        std::atomic<int32_t> mValue;
+        /// @endcond
+    };
+
+    /// @brief timer that accumulates durations measured in ticks of tick source
+    /// @see setTickSource(), scopedTimer_t
+    class timing_t
+    {
+      public:
+        timing_t()
+        { reset(); }
+
+        /// @brief adds one measured duration
+        void record(uint32_t ticks)
+        {
+          shard_t & s = mShards[privShard()];
+          s.count.fetch_add(1, std::memory_order_relaxed);
+          s.total.fetch_add(ticks, std::memory_order_relaxed);
+
+          uint32_t max = s.max.load(std::memory_order_relaxed);
+          while(ticks > max && !s.max.compare_exchange_weak(max, ticks, std::memory_order_relaxed))
+          {}
+        }
+
+        /// @brief sets all values to zero
+        void reset()
+        {
+          for(auto & s : mShards)
+          {
+            s.count.store(0, std::memory_order_relaxed);
+            s.total.store(0, std::memory_order_relaxed);
+            s.max.store(0, std::memory_order_relaxed);
+          }
+        }
+
+      private:
+        /// @cond
+        friend class DiagTask;
+
+        struct alignas(DIAGTASK_METRIC_ALIGN) shard_t
+        {
+          std::atomic<uint32_t> count;
+          std::atomic<uint32_t> total;
+          std::atomic<uint32_t> max;
+        };
+        shard_t mShards[DIAGTASK_METRIC_SHARDS];
+        /// @endcond
+    };
+
+    /// @brief measures the lifetime of this object and adds it to a timing_t
+    class scopedTimer_t
+    {
+      public:
+        explicit scopedTimer_t(timing_t & timer)
+          : mTimer(timer), mStart(spInstance ? spInstance->privTicks() : 0)
+        {}
+
+        ~scopedTimer_t()
+        {
+          if(spInstance)
+          { mTimer.record(spInstance->privTicks() - mStart); }
+        }
+
+      private:
+        /// @cond
+        scopedTimer_t(const scopedTimer_t &);
+        scopedTimer_t & operator=(const scopedTimer_t &);
+
+        timing_t & mTimer;
+        uint32_t  mStart;
+        /// @endcond
+    };
+#endif // DIAGTASK_ENABLE_METRICS
+
+#if DIAGTASK_ENABLE_CHUNKED_HOOKS
+    /// @brief callbacks of a chunked hook (see registerChunkedHook())
+    struct chunkedHook_t
+    {
+      /// @brief called when hook name is complete (optional)
+      void (*begin)();
+      /// @brief called for each received part of the argument
+      void (*data)(const char * data, uint16_t len);
+      /// @brief called at end of line (complete is true) or if ESC was received (optional)
+      void (*end)(bool complete);
+    };
+#endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+
+#if DIAGTASK_ENABLE_UPLOAD
+    /// @brief callbacks that receive an upload (see setUploadSink())
+    struct uploadSink_t
+    {
+      /// @brief called by "recv <name>"; returns false to reject upload
+      bool (*open)(const char * name);
+      /// @brief called for each received block in order; returns false to abort upload
+      bool (*write)(uint32_t offset, const uint8_t * data, uint16_t len);
+      /// @brief called at end of upload. complete is false if aborted or crc is wrong
+      void (*close)(bool complete);
     };
+#endif // DIAGTASK_ENABLE_UPLOAD
+
+#if DIAGTASK_ENABLE_SINKS
+    /// @brief what happens if a sink is slower than output and the ring is full
+    enum sinkPolicy_t
+    {
+      sink_DropOldest,  ///< oldest output that was not written to sink is overwritten
+      sink_Resync       ///< all pending output of sink is dropped; it continues with new output
+    };
+#endif // DIAGTASK_ENABLE_SINKS
 
   private:
 
     /// @cond
-    struct hookEntry_t
+    // hook without its name
+    struct hookSlot_t
     {
-      char name[DIAGTASK_MAX_HOOKNAME_LEN+1];
+      #if DIAGTASK_HOOKDESC_LEN
       char description[DIAGTASK_HOOKDESC_LEN+1];
+      #else
+      const char * description;        // not copied
+      #endif
       void(*hook)(const char* input);  // current input line
+      #if DIAGTASK_ENABLE_CHUNKED_HOOKS
+      const chunkedHook_t * chunked;   // used instead of hook if not NULL
+      #endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+      #if DIAGTASK_ENABLE_PATTERNS
+      void(*argsHook)(uint8_t argc, char * argv[]);  // used instead of hook if not NULL
+      #endif // DIAGTASK_ENABLE_PATTERNS
+      #if DIAGTASK_ENABLE_MACROS
+      uint8_t macro;                   // index + 1 of macro that runs instead of hook, else 0
+      #endif // DIAGTASK_ENABLE_MACROS
+    };
+
+    struct hookEntry_t : hookSlot_t
+    {
+      char name[DIAGTASK_MAX_HOOKNAME_LEN+1];
+    };
+
+    struct hookName_t
+    {
+      char name[DIAGTASK_MAX_HOOKNAME_LEN+1];
+    };
+
+    // hook that matches current input; its slot is read from mHooks when it is called
+    struct filterredHook_t : hookName_t
+    {
+      uint16_t index;
     };
 
+    #if DIAGTASK_HOOK_KEY_LEN && !DIAGTASK_NAME_POOL_LEN
+    // leading characters of 16 hook names stored by column, so that one vector compare
+    // checks one character of 16 hooks. 0xff matches any character (behind a wildcard).
+    struct hookKeys_t
+    {
+      uint8_t column[DIAGTASK_HOOK_KEY_LEN][16];
+    };
+    #endif
+
     #if DIAGTASK_USE_ETL
-    typedef etl::vector<DiagTask::hookEntry_t, DIAGTASK_MAX_HOOKS> diagtask_vector;
+    typedef etl::vector<DiagTask::filterredHook_t, DIAGTASK_MAX_HOOKS> diagtask_vector;
     #else
-    typedef std::vector<DiagTask::hookEntry_t> diagtask_vector;
+    typedef std::vector<DiagTask::filterredHook_t> diagtask_vector;
     #endif
 
-    diagtask_vector mHooks;
+    #if DIAGTASK_USE_ETL
+    typedef etl::vector<DiagTask::hookSlot_t, DIAGTASK_MAX_HOOKS> diagtask_slot_vector;
+    typedef etl::vector<DiagTask::hookName_t, DIAGTASK_MAX_HOOKS> diagtask_name_vector;
+    #else
+    typedef std::vector<DiagTask::hookSlot_t> diagtask_slot_vector;
+    typedef std::vector<DiagTask::hookName_t> diagtask_name_vector;
+    #endif
+
+    // hooks are stored as structure of arrays: names are scanned without loading
+    // descriptions and functions of mHooks, which are only read for matching hooks.
+    diagtask_slot_vector mHooks;
+    #if DIAGTASK_NAME_POOL_LEN
+    uint16_t mNamePoolLen;    // names of mHooks, sorted and front-coded
+    char     mNamePool[DIAGTASK_NAME_POOL_LEN];
+    #else
+    diagtask_name_vector mHookNames;  // names of mHooks
+    #if DIAGTASK_HOOK_KEY_LEN
+    #if DIAGTASK_USE_ETL
+    etl::vector<hookKeys_t, (DIAGTASK_MAX_HOOKS + 15) / 16> mHookKeys;
+    #else
+    std::vector<hookKeys_t> mHookKeys;    // keys of 16 hooks of mHookNames each
+    #endif
+    #endif // DIAGTASK_HOOK_KEY_LEN
+    #endif // DIAGTASK_NAME_POOL_LEN
     diagtask_vector mFilterredHooks;
 
     unsigned int mFeatures;
 
+    #if DIAGTASK_ENABLE_HELP || DIAGTASK_ENABLE_TAB_COMPLETION
+    uint8_t  mHelpWidth;      // length of longest hook name; 0 if hooks changed
+    #endif
+    #if DIAGTASK_ENABLE_HELP && DIAGTASK_HELP_CACHE_LEN
+    uint16_t mHelpLen;        // length of rendered help; 0 if hooks changed
+    char     mHelpCache[DIAGTASK_HELP_CACHE_LEN];
+    #endif
+
     // hold user input that still matches any hook name in array.
     // if user inputs a new character, all hook names are checked. if
     // new potential hook name is not found, mCurrentValidInput is reset.
     char mCurrentValidInput[DIAGTASK_MAX_HOOK_INPUT_LEN+1]; // add space for '\0'
+#if DIAGTASK_ENABLE_IGNORE_CASE
+    char mFoldedInput[DIAGTASK_MAX_HOOK_INPUT_LEN+1];       // mCurrentValidInput in lower case
+#endif // DIAGTASK_ENABLE_IGNORE_CASE
     int (*mGetchar)();
     uint32_t (*mUptime)();
     void (*mReboot)();
+    void (*mWrite)(const char* data, uint16_t len);
+    void (*mDescribe)(const char * name, char * buf, uint16_t size);
+    uint32_t (*mTicks)();
+    uint32_t mTicksPerSecond;
+
+    // resumable command that is continued by each call of process() until
+    // step() returns false. ESC aborts the job.
+    struct job_t
+    {
+      bool (DiagTask::*step)();
+      const uint8_t * addr;
+      uint32_t        remaining;
+      #if DIAGTASK_ENABLE_MEMORY
+      uint32_t        value;    // checksum or number of matches
+      uint8_t         pattern[DIAGTASK_MEMORY_PATTERN_LEN];
+      uint8_t         patternLen;
+      #endif // DIAGTASK_ENABLE_MEMORY
+    };
+    job_t mJob;
+
+    unsigned int mBuiltins; // features of which built-in commands are registerred
+    const hookEntry_t * mCurrentHook; // hook that is currently called
+
+    #if DIAGTASK_ENABLE_CHUNKED_HOOKS
+    hookEntry_t mChunkedHook; // chunked hook that receives current input if chunked is set
+    #endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+
+    #if DIAGTASK_ENABLE_UPLOAD
+    const uploadSink_t * mUploadSink;
+    bool     mUploading;      // process() reads upload blocks instead of commands
+    bool     mUploadNak;      // nak was sent for mUploadSeq
+    uint8_t  mUploadSeq;      // sequence of next expected block
+    uint16_t mUploadPos;      // bytes of current block received including sync; 0 = wait for sync
+    uint32_t mUploadOffset;   // bytes written to sink
+    uint32_t mUploadCrc;      // crc-32 of bytes written to sink
+    uint32_t mUploadTime;     // ticks of last received byte
+    uint8_t  mUploadBlock[DIAGTASK_UPLOAD_BLOCK_LEN + 7]; // length, sequence, type, payload, crc-32
+    #endif // DIAGTASK_ENABLE_UPLOAD
+
+    #if DIAGTASK_ENABLE_DOWNLOAD
+    // region of last download. it is kept after end of download to allow resume.
+    struct download_t
+    {
+      const uint8_t * data;
+      uint32_t        size;
+      uint32_t        start;      // index of first byte in data (ring buffer)
+      uint32_t        offset;     // next byte to send
+      uint32_t        crcOffset;  // crc covers bytes before crcOffset
+      uint32_t        crc;
+    };
+    download_t mDownload;
+    #endif // DIAGTASK_ENABLE_DOWNLOAD
+
+    #if DIAGTASK_ENABLE_SINKS || DIAGTASK_ENABLE_BUDGETS
+    // limits output to rate bytes per second with bursts of up to burst bytes
+    struct tokenBucket_t
+    {
+      uint32_t rate;        // bytes per second, 0 = unlimited
+      uint32_t burst;
+      int32_t  tokens;      // bytes that may be written; negative after output of jobs
+      uint32_t last;        // ticks of last refill
+    };
+    #endif // DIAGTASK_ENABLE_SINKS || DIAGTASK_ENABLE_BUDGETS
+
+    #if DIAGTASK_ENABLE_SINKS
+    struct sinkEntry_t
+    {
+      int    (*write)(const char * data, uint16_t len);  // NULL if slot is unused
+      uint32_t cursor;      // position of next byte in mSinkRing (not wrapped)
+      uint32_t dropped;     // bytes lost because of sink policy
+      tokenBucket_t bucket;
+      uint8_t  policy;
+    };
+    sinkEntry_t mSinks[DIAGTASK_MAX_SINKS];
+    uint32_t    mSinkHead;  // position of next byte written to mSinkRing (not wrapped)
+    char        mSinkRing[DIAGTASK_SINK_RING_LEN];
+    #endif // DIAGTASK_ENABLE_SINKS
+
+    #if DIAGTASK_ENABLE_BUDGETS
+    struct hookBudget_t
+    {
+      char          name[DIAGTASK_MAX_HOOKNAME_LEN+1];
+      tokenBucket_t bucket;
+    };
+    hookBudget_t    mHookBudgets[DIAGTASK_MAX_HOOK_BUDGETS];
+    uint8_t         mHookBudgetCount;
+    tokenBucket_t   mSessionBudget;
+    tokenBucket_t * mHookBudget;  // budget of current hook
+    bool            mTruncated;   // output is dropped until a write fits into budget
+    bool            mUnlimited;   // output is not limited (frames)
+    bool            mInJob;       // output of jobs may exceed budget; job is suspended then
+    #endif // DIAGTASK_ENABLE_BUDGETS
+
+    #if DIAGTASK_ENABLE_COMPRESSION
+    bool     mCompress;
+    uint16_t mZipHead;        // position of next byte in mZipWindow
+    uint16_t mZipFilled;      // number of valid bytes in mZipWindow
+    uint8_t  mZipTokens;      // number of tokens in mZipGroup
+    uint8_t  mZipGroupLen;    // bytes in mZipGroup
+    uint8_t  mZipGroup[1 + 8 * 2];  // flags, up to 8 literals or matches
+    uint8_t  mZipWindow[1 << DIAGTASK_COMPRESS_WINDOW_BITS]; // last bytes of output
+    #endif // DIAGTASK_ENABLE_COMPRESSION
+
+    #if DIAGTASK_ENABLE_METRICS
+    enum metricType_t
+    {
+      metric_Counter,
+      metric_Gauge,
+      metric_Timer
+    };
+
+    struct metricEntry_t
+    {
+      const char * name;
+      void *       metric;
+      uint8_t      type;
+      uint32_t     snapshot; // value of last "metrics snap" (counter only)
+    };
+
+    #if DIAGTASK_USE_ETL
+    typedef etl::vector<DiagTask::metricEntry_t, DIAGTASK_MAX_METRICS> metric_vector;
+    #else
+    typedef std::vector<DiagTask::metricEntry_t> metric_vector;
+    #endif
+
+    metric_vector mMetrics;
+    #endif // DIAGTASK_ENABLE_METRICS
+
+    #if DIAGTASK_ENABLE_VARIABLES
+    enum varType_t
+    {
+      var_Bool,
+      var_U8,
+      var_I8,
+      var_U16,
+      var_I16,
+      var_U32,
+      var_I32,
+      var_Float
+    };
+
+    enum varFlags_t
+    {
+      var_ReadOnly = 0x01,
+      var_Range    = 0x02   // min/max are valid
+    };
+
+    struct varEntry_t
+    {
+      const char * name;
+      void *       variable;
+      int32_t      min;
+      int32_t      max;
+      uint8_t      type;
+      uint8_t      flags;
+    };
+
+    #if DIAGTASK_USE_ETL
+    typedef etl::vector<DiagTask::varEntry_t, DIAGTASK_MAX_VARIABLES> var_vector;
+    #else
+    typedef std::vector<DiagTask::varEntry_t> var_vector;
+    #endif
+
+    var_vector mVariables;
+    #endif // DIAGTASK_ENABLE_VARIABLES
+
+    #if DIAGTASK_ENABLE_STREAM
+    uint8_t  mStreamVars[DIAGTASK_STREAM_MAX_VARIABLES];  // index into mVariables
+    int32_t  mStreamPrev[DIAGTASK_STREAM_MAX_VARIABLES];  // last values for delta frames
+    uint8_t  mStreamCount;    // number of streamed variables, 0: stream is off
+    uint8_t  mStreamSeq;      // sequence number of next sample
+    bool     mStreamDelta;
+    bool     mStreamKey;      // next sample must be complete (sample was dropped)
+    bool     mStreamDescribe; // description must be sent (again) before next sample
+    uint32_t mStreamPeriod;   // ticks between two samples, 0: only streamSample()
+    uint32_t mStreamNext;     // tick of next sample
+
+    // frames written by streamSample() and sent by process() (single producer/consumer)
+    uint8_t               mStreamBuf[DIAGTASK_STREAM_BUFFER_LEN];
+    std::atomic<uint16_t> mStreamHead;
+    std::atomic<uint16_t> mStreamTail;
+    std::atomic<uint32_t> mStreamDropped;
+    #endif // DIAGTASK_ENABLE_STREAM
+
+    #if DIAGTASK_ENABLE_TRIGGERS
+    struct triggerEntry_t
+    {
+      uint8_t  code[DIAGTASK_TRIGGER_CODE_LEN];       // compiled condition
+      char     action[DIAGTASK_MAX_HOOK_INPUT_LEN+1]; // hook name and argument
+      hookEntry_t hook; // hook of action, looked up once by addTrigger()
+      uint8_t  arg;     // argument of hook at action[arg]
+      uint16_t hits;
+      bool     active;  // condition was true at last evaluation
+      bool     removed; // removed by an action; deleted after evaluation
+    };
+
+    // state of condition compiler
+    struct triggerParser_t
+    {
+      const char * pos;
+      const char * end;
+      uint8_t *    code;
+      uint8_t      len;
+      uint8_t      depth;
+      bool         error;
+    };
+
+    triggerEntry_t mTriggers[DIAGTASK_MAX_TRIGGERS];
+    uint8_t        mTriggerCount;
+    bool           mTriggerRunning; // avoid recursion if action evaluates triggers
+    #endif // DIAGTASK_ENABLE_TRIGGERS
+
+    #if DIAGTASK_ENABLE_MACROS
+    // one hook call of a macro. the hook is looked up once when the macro is defined.
+    struct macroStep_t
+    {
+      hookEntry_t hook;
+      char        arg[DIAGTASK_MAX_HOOK_INPUT_LEN+1];
+    };
+
+    struct macroEntry_t
+    {
+      char    name[DIAGTASK_MAX_HOOKNAME_LEN+1];  // registerred hook name, "" if unused
+      uint8_t first;  // index of first step in mMacroSteps
+      uint8_t count;
+    };
+
+    macroEntry_t mMacros[DIAGTASK_MAX_MACROS];
+    macroStep_t  mMacroSteps[DIAGTASK_MACRO_STEPS];  // steps of all macros in order of mMacros
+    uint8_t      mMacroStepCount;
+    #endif // DIAGTASK_ENABLE_MACROS
+
+    #if DIAGTASK_ENABLE_CAPTURE
+    enum captureState_t
+    {
+      capture_Off,
+      capture_Armed,      // sampling, waiting for trigger
+      capture_Triggered,  // sampling remaining samples after trigger
+      capture_Frozen      // buffer holds samples before and after trigger
+    };
+
+    uint8_t  mCaptureVars[DIAGTASK_CAPTURE_MAX_VARIABLES];  // index into mVariables
+    uint8_t  mCaptureCount;       // number of captured variables
+    uint8_t  mCaptureSampleLen;   // bytes of one sample
+    volatile uint8_t mCaptureState;
+    uint16_t mCaptureSamples;     // capacity of buffer in samples
+    uint16_t mCaptureIndex;       // next sample written
+    uint16_t mCaptureFilled;      // number of valid samples
+    uint16_t mCapturePost;        // samples taken after trigger
+    uint16_t mCaptureRemaining;   // samples to take until buffer is frozen
+    uint32_t mCapturePeriod;      // ticks between two samples, 0: only captureSample()
+    uint32_t mCaptureNext;
+    uint8_t  mCaptureBuf[DIAGTASK_CAPTURE_BUFFER_LEN];
+    #endif // DIAGTASK_ENABLE_CAPTURE
+
+    // built-in commands are static functions and access instance via this pointer
+    static DiagTask * spInstance;
+
+    #if DIAGTASK_ENABLE_LOG
+    static_assert((DIAGTASK_LOG_ENTRIES & (DIAGTASK_LOG_ENTRIES - 1)) == 0,
+                  "DIAGTASK_LOG_ENTRIES must be a power of two");
+
+    // one unformatted log message. 'sequence' tells if entry is free, written or
+    // still in use (bounded multi producer queue).
+    struct logEntry_t
+    {
+      std::atomic<uint32_t> sequence;
+      const char *          fmt;
+      const logModule_t *   module;
+      uint8_t               level;
+      uint8_t               count;
+      uint64_t              args[DIAGTASK_LOG_MAX_ARGS];
+    };
+
+    #if DIAGTASK_USE_ETL
+    typedef etl::vector<DiagTask::logModule_t*, DIAGTASK_LOG_MAX_MODULES> logModule_vector;
+    #else
+    typedef std::vector<DiagTask::logModule_t*> logModule_vector;
+    #endif
+
+    logModule_vector      mLogModules;
+
+    logEntry_t            mLog[DIAGTASK_LOG_ENTRIES];
+    std::atomic<uint32_t> mLogHead;     // next position written by log()
+    uint32_t              mLogTail;     // next position formatted by process()
+    std::atomic<uint32_t> mLogDropped;  // messages lost because ring buffer was full
+    #endif // DIAGTASK_ENABLE_LOG
   /// @endcond
 
   public:
@@ -212,6 +1165,20 @@ class DiagTask
     /// @brief enables some build-in features
     void enableFeatures(unsigned int features);
 
+    /** @brief sets function that receives all output of diagtask
+     * If no function is set, output is written to stdout.
+     * @param write function pointer to function that writes len bytes of data
+     *              to serial console.
+     */
+    void setOutput(void (*write)(const char* data, uint16_t len));
+
+    /** @brief sets a high resolution time source used for time stamps and measurements
+     * If no function is set, uptime (seconds) is used.
+     * @param ticks function pointer to function that returns a free running counter
+     * @param ticksPerSecond frequency of counter
+     */
+    void setTickSource(uint32_t (*ticks)(), uint32_t ticksPerSecond);
+
     /// @brief main diag task process
     /**
      * This task should be called repeatly to process hook inputs and call registerred functions.
@@ -224,18 +1191,397 @@ class DiagTask
     /** @brief registers a new hook
      * @param name name of the hook
      * @param hook function pointer to function that is called when hook is actiated
-     * @param description description is displayed when all hooks are listed (press "?")
+     * @param description description is displayed when all hooks are listed (press "?").
+     *        Must remain valid if DIAGTASK_HOOKDESC_LEN is 0. If it is empty, the description
+     *        is read via setHookDescriptions().
      * \return returns true on success, else false
      */
     bool registerHook( const char * name, void(*hook)(const char* input)
                      , const char * description = "");
 
+    /** @brief sets a function that reads descriptions on demand
+     *
+     * Used for hooks registerred with an empty description, so descriptions can stay in a
+     * table in flash (e.g. PROGMEM) and may be longer than DIAGTASK_HOOKDESC_LEN.
+     * @param describe copies the '\0' terminated description of hook name into buf
+     *        (size bytes); NULL disables it
+     */
+    void setHookDescriptions(void (*describe)(const char * name, char * buf, uint16_t size));
+
+    /** @brief removes a hook
+     * @param name name of the hook as registerred (e.g. "get *")
+     * \return returns true on success, false if hook was not found
+     */
+    bool unregisterHook(const char * name);
+
+#if DIAGTASK_ENABLE_CHUNKED_HOOKS
+    /** @brief registers a hook that receives its argument in chunks
+     *
+     * The name must contain a wildcard. When the input matches the name up to the wildcard,
+     * begin() is called and all following characters of the line are passed to data()
+     * as they arrive, without limit by DIAGTASK_MAX_HOOK_INPUT_LEN. '\n' calls end(true),
+     * ESC calls end(false).
+     * @param name name of the hook (e.g. "config *")
+     * @param hook callbacks, must remain valid (e.g. static const)
+     * @param description description is displayed when all hooks are listed (press "?")
+     * \return returns true on success, else false
+     */
+    bool registerChunkedHook( const char * name, const chunkedHook_t & hook
+                            , const char * description = "");
+#endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+
+#if DIAGTASK_ENABLE_PATTERNS
+    /** @brief registers a hook whose name contains several placeholders
+     *
+     * Each "*" or "<name>" placeholder matches one word of the input; the last placeholder
+     * matches the rest of the line. A space in the name matches any number of spaces.
+     * The hook is called with the matched words when '\n' is received, e.g. name
+     * "dev <id> read <addr>" and input "dev 2 read 0x40" pass argv {"2", "0x40"}.
+     * Several pattern hooks may start with the same text (e.g. "dev <id> write <addr> <val>");
+     * the first one that matches the line is called. If none matches, their names are
+     * printed as usage.
+     * @param name name of the hook
+     * @param hook function that receives the matched words (argc <= DIAGTASK_MAX_PATTERN_ARGS)
+     * @param description description is displayed when all hooks are listed (press "?")
+     * \return returns true on success, else false
+     */
+    bool registerPatternHook( const char * name, void(*hook)(uint8_t argc, char * argv[])
+                            , const char * description = "");
+#endif // DIAGTASK_ENABLE_PATTERNS
+
+#if DIAGTASK_ENABLE_UPLOAD
+    /** @brief sets callbacks that receive files uploaded by "recv <name>"
+     *
+     * "recv" switches process() into binary mode. It reads blocks sent by the host
+     * (tools/diagtask_host.py upload) and passes their payload without copy to
+     * write(). Blocks are protected by crc-32 and acknowledged; lost or damaged blocks
+     * are sent again by the host. Command input is processed after the upload ended.
+     * "recv" requires a tick source (setTickSource() or uptime of constructor) for its
+     * timeouts; ESC after a pause between blocks cancels the upload.
+     * @param sink callbacks, must remain valid (e.g. static const)
+     */
+    void setUploadSink(const uploadSink_t & sink);
+#endif // DIAGTASK_ENABLE_UPLOAD
+
+#if DIAGTASK_ENABLE_DOWNLOAD
+    /** @brief sends a memory region as binary frames (tools/diagtask_host.py download)
+     *
+     * process() sends DIAGTASK_DOWNLOAD_CHUNK bytes per call directly from data. Each frame
+     * contains its offset; the host requests missing frames with "dl resume <offset>".
+     * The last frame contains size and crc-32 of the region.
+     * Data must remain valid until the host received it.
+     * @param data first byte of region
+     * @param size number of bytes
+     * @param start offset in region of first byte to send. Bytes behind end of region
+     *              continue at data (ring buffer with oldest entry at start).
+     * \return returns false if another command is running
+     */
+    bool startDownload(const void * data, uint32_t size, uint32_t start = 0);
+#endif // DIAGTASK_ENABLE_DOWNLOAD
+
+#if DIAGTASK_ENABLE_SINKS
+    /** @brief adds a sink that receives all output
+     *
+     * Output is stored once in a ring of DIAGTASK_SINK_RING_LEN bytes. Each sink has its own
+     * position in this ring and is written as fast as it accepts data, so a slow sink does
+     * not delay other sinks or process(). If a sink falls behind by more than the ring,
+     * policy decides which output it loses. Output set by setOutput() is not used
+     * while sinks exist.
+     * @param write function that writes up to len bytes without blocking. Returns number
+     *              of bytes written, 0 if sink is busy or negative if it is disconnected
+     *              (pending output of sink is dropped).
+     * @param bytesPerSecond maximal output rate of sink, 0 for no limit
+     * @param policy see sinkPolicy_t
+     * \return returns id of sink or -1 if all slots are used
+     */
+    int addSink( int (*write)(const char * data, uint16_t len), uint32_t bytesPerSecond = 0
+               , sinkPolicy_t policy = sink_DropOldest);
+
+    /** @brief removes a sink
+     * @param id id returned by addSink()
+     * \return returns true on success, else false
+     */
+    bool removeSink(int id);
+#endif // DIAGTASK_ENABLE_SINKS
+
+#if DIAGTASK_ENABLE_BUDGETS
+    /** @brief limits all output of diagtask (token bucket)
+     *
+     * Output that exceeds the budget is truncated and DIAGTASK_BUDGET_MARKER is written.
+     * Commands that run over several calls of process() (e.g. "md") are suspended
+     * instead until budget is available. Binary frames are not limited.
+     * Requires a tick source (setTickSource() or uptime of constructor).
+     * @param bytesPerSecond average output rate, 0 for no limit
+     * @param burst maximal bytes written at once, 0 for bytesPerSecond (max. INT32_MAX)
+     * \return returns false if there is no tick source
+     */
+    bool setOutputBudget(uint32_t bytesPerSecond, uint32_t burst = 0);
+
+    /** @brief limits output of one hook in addition to setOutputBudget()
+     * @param name name of the hook
+     * @param bytesPerSecond average output rate, 0 for no limit
+     * @param burst maximal bytes written at once, 0 for bytesPerSecond (max. INT32_MAX)
+     * \return returns false if too many hooks have a budget or there is no tick source
+     */
+    bool setHookBudget(const char * name, uint32_t bytesPerSecond, uint32_t burst = 0);
+#endif // DIAGTASK_ENABLE_BUDGETS
+
+    /** @brief writes data to output of diagtask
+     * Hooks should use this function or print() instead of printf() to be subject to
+     * compression, sinks and output budgets.
+     * @param data data to write
+     * @param len number of bytes
+     */
+    void write(const char * data, uint16_t len)
+    { privWrite(data, len); }
+
+    /** @brief formats a string like printf() and writes it to output of diagtask
+     * @param fmt printf() like format string, see format()
+     */
+    void print(const char * fmt, ...)
+    #ifdef __GNUC__
+      __attribute__((format(printf, 2, 3)))
+    #endif
+    ;
+
+    /** @brief formats a string like snprintf() without stdio
+     *
+     * Supports flags "-0+ ", width, precision, '*', length modifiers and the conversions
+     * d i u o x X c s p f e g and "%%". Floats are printed at double precision with up to
+     * 17 digits (f switches to exponent notation from 1e19); long double ("%Lf") is not
+     * supported and printed as it is.
+     * @param buf output buffer, always terminated with '\0'
+     * @param size size of buf
+     * @param fmt printf() like format string
+     * \return returns number of characters written to buf (without '\0')
+     */
+    static uint16_t format(char * buf, uint16_t size, const char * fmt, ...)
+    #ifdef __GNUC__
+      __attribute__((format(printf, 3, 4)))
+    #endif
+    ;
+
+#if DIAGTASK_ENABLE_COMPRESSION
+    /** @brief enables lzss compression of all output
+     *
+     * A frame announces the start of compressed output. tools/diagtask_host.py decompress
+     * restores the original output. Output is flushed by next call of process().
+     * Compression must be disabled for upload and download.
+     * @param enable true to compress output
+     */
+    void setCompression(bool enable);
+#endif // DIAGTASK_ENABLE_COMPRESSION
+
     /** @brief calles a hook function (allows to call named hook)
      * @param name name of the hook
      * \return returns true on success, else false
      */
     bool executeHook(const char * name);
 
+#if DIAGTASK_ENABLE_LOG
+    /*!
+      * @brief  Stores a log message without formatting it
+      *
+      * Only the pointer to the format string and the raw arguments are copied into the
+      * log ring buffer. Formatting (printf() syntax) is done later by process().
+      * This function is lock-free and may be called from any thread or interrupt.
+      * Because formatting is deferred, format string and all strings passed
+      * as "%s" arguments must remain valid (e.g. string literals).
+      *
+      * @param  fmt  printf() like format string
+      * @param  args up to DIAGTASK_LOG_MAX_ARGS arguments (integers, floats, pointers)
+      * \return true on success
+      *         \li false when ring buffer was full and message was dropped
+      * @see DIAGTASK_ENABLE_LOG
+      */
+    template<typename... Args>
+    bool log(const char * fmt, Args... args)
+    {
+      const uint64_t values[sizeof...(Args) + 1] = { privLogArg(args)..., 0 };
+      return privLog(NULL, 0, fmt, values, sizeof...(Args));
+    }
+
+    /*!
+      * @brief  Stores a log message of a module without formatting it
+      *
+      * Same as log(fmt, args...), but message is prefixed with module name and level.
+      * Level is not checked; use DIAGTASK_LOG() to filter messages before calling log().
+      * @param  module log module
+      * @param  level  log level of message
+      * @param  fmt    printf() like format string
+      * @param  args   up to DIAGTASK_LOG_MAX_ARGS arguments
+      * @see DIAGTASK_LOG()
+      */
+    template<typename... Args>
+    bool log(const logModule_t & module, uint8_t level, const char * fmt, Args... args)
+    {
+      const uint64_t values[sizeof...(Args) + 1] = { privLogArg(args)..., 0 };
+      return privLog(&module, level, fmt, values, sizeof...(Args));
+    }
+
+    /** @brief registers a log module. Its level can be changed via console command
+     *         "log-level <module> <level>" (feature_Log)
+     * @param module log module
+     * \return returns true on success, else false
+     */
+    bool registerLogModule(logModule_t & module);
+#endif // DIAGTASK_ENABLE_LOG
+
+#if DIAGTASK_ENABLE_METRICS
+    /** @brief registers a counter, gauge or timer
+     *
+     * The name is registerred as hook. Entering the name prints the value.
+     * With feature_Metrics enabled, "metrics " lists all metrics, "metrics reset" clears them
+     * and "metrics snap" prints the change of all counters since the previous snapshot.
+     * @param name   name of metric (string is not copied)
+     * @param metric metric that must exist as long as DiagTask exists
+     * @param description description is displayed when all hooks are listed (press "?")
+     * \return returns true on success, else false
+     */
+    bool registerMetric(const char * name, counter_t & metric, const char * description = "counter")
+    { return privRegisterMetric(name, &metric, metric_Counter, description); }
+
+    /// @copydoc registerMetric(const char*, counter_t&, const char*)
+    bool registerMetric(const char * name, gauge_t & metric, const char * description = "gauge")
+    { return privRegisterMetric(name, &metric, metric_Gauge, description); }
+
+    /// @copydoc registerMetric(const char*, counter_t&, const char*)
+    bool registerMetric(const char * name, timing_t & metric, const char * description = "timer")
+    { return privRegisterMetric(name, &metric, metric_Timer, description); }
+#endif // DIAGTASK_ENABLE_METRICS
+
+#if DIAGTASK_ENABLE_VARIABLES
+    /** @brief registers a variable that can be read and written from console
+     *
+     * With feature_Variables enabled, "get <name>" prints the value, "set <name> <value>"
+     * writes the variable and "vars [prefix]" lists all variables.
+     * Supported types: bool, uint8_t, int8_t, uint16_t, int16_t, uint32_t, int32_t, float
+     * @param name     name of variable (string is not copied)
+     * @param variable variable that must exist as long as DiagTask exists
+     * @param readOnly true if variable must not be written via "set"
+     * \return returns true on success, else false
+     */
+    template<typename T>
+    bool registerVariable(const char * name, T & variable, bool readOnly = false)
+    {
+      return privRegisterVariable(name, &variable, privVarType(&variable),
+                                  readOnly ? var_ReadOnly : 0, 0, 0);
+    }
+
+    /** @brief registers a variable with a valid range
+     * @param name     name of variable (string is not copied)
+     * @param variable variable that must exist as long as DiagTask exists
+     * @param min      minimal value accepted by "set"
+     * @param max      maximal value accepted by "set"
+     * \return returns true on success, else false
+     */
+    template<typename T>
+    bool registerVariable(const char * name, T & variable, int32_t min, int32_t max)
+    {
+      return privRegisterVariable(name, &variable, privVarType(&variable), var_Range, min, max);
+    }
+#endif // DIAGTASK_ENABLE_VARIABLES
+
+#if DIAGTASK_ENABLE_STREAM
+    /** @brief starts binary streaming of variables
+     *
+     * Each sample is sent as frame: 0xA5, length, sequence, type, payload, crc8.
+     * Type 0 holds the raw values, type 1 the zigzag varint encoded difference to
+     * the previous sample (delta mode), type 2 describes the streamed variables.
+     * See tools/diagtask_host.py for a decoder.
+     * With feature_Stream enabled, the console command "stream" calls this function.
+     * @param variables space separated list of variable names
+     * @param rate      samples per second, 0 if samples are only taken by streamSample().
+     *                  Must not exceed ticks per second of tick source (see setTickSource())
+     * @param delta     true to send differences to previous sample
+     * \return returns true on success, else false
+     */
+    bool startStream(const char * variables, uint32_t rate, bool delta = false);
+
+    /// @brief stops streaming
+    void stopStream();
+
+    /** @brief takes one sample of streamed variables
+     *
+     * May be called from control loop or timer interrupt to get an exact sample rate.
+     * Samples are written to the output by process().
+     * \return returns true on success, false when buffer was full
+     */
+    bool streamSample();
+#endif // DIAGTASK_ENABLE_STREAM
+
+#if DIAGTASK_ENABLE_TRIGGERS
+    /** @brief adds a trigger
+     *
+     * The condition is compiled once into a small byte code and evaluated by process()
+     * and evaluateTriggers(). When the condition changes from false to true, the action
+     * is executed like executeHook(). Its hook is looked up once here; a hook removed
+     * later is still called by the trigger.
+     * Conditions use registerred variables (as integers), decimal or hexadecimal numbers,
+     * parentheses and the operators: ! - + == != < <= > >= && ||
+     * With feature_Triggers enabled, console command "trig <condition> then <hook>"
+     * calls this function.
+     * @param condition condition, e.g. "current > 1200 && state == 3"
+     * @param action    name of hook and optional argument for wildcard hooks
+     * \return returns true on success, else false
+     */
+    bool addTrigger(const char * condition, const char * action);
+
+    /// @brief removes trigger with index (as listed by "trig")
+    bool removeTrigger(uint8_t index);
+
+    /// @brief evaluates all triggers. May be called by firmware at any point of interest.
+    void evaluateTriggers();
+#endif // DIAGTASK_ENABLE_TRIGGERS
+
+#if DIAGTASK_ENABLE_MACROS
+    /** @brief defines an alias or macro
+     *
+     * The macro is registerred as hook. Its lines are looked up once here; calling the
+     * macro calls the found hooks in order without looking them up again. A macro of one
+     * line whose hook takes an argument is an alias: input behind its name is appended to
+     * the argument of the line (alias "g" of "get" passes "g x" as "x").
+     * Lines that name another macro are replaced by the lines of that macro. Hooks removed
+     * later are still called by macros defined before.
+     * With feature_Macros enabled, console commands "alias <name> = <hook>" and
+     * "macro <name> = <line>;<line>.." call this function.
+     * @param name  name of the macro; replaces macro with same name, which is kept if this
+     *              fails. Lines of the replacement must not name the macro itself
+     * @param lines hook names with optional argument, separated by ';'
+     * \return returns true on success, else false
+     */
+    bool addMacro(const char * name, const char * lines);
+
+    /// @brief removes macro with name (as passed to addMacro())
+    bool removeMacro(const char * name);
+#endif // DIAGTASK_ENABLE_MACROS
+
+#if DIAGTASK_ENABLE_CAPTURE
+    /** @brief starts capturing variables into ring buffer
+     *
+     * Samples are taken with a fixed rate until triggerCapture() is called. After
+     * postSamples more samples, the buffer is frozen and can be downloaded via
+     * console command "cap dump" (binary frames, see startStream()).
+     * With feature_Capture enabled, "cap <rate> <post> <var>.." calls this function and
+     * "cap trig" can be used as trigger action.
+     * @param variables   space separated list of variable names
+     * @param rate        samples per second, 0 if samples are only taken by captureSample().
+     *                    Must not exceed ticks per second of tick source (see setTickSource())
+     * @param postSamples number of samples taken after trigger
+     * \return returns true on success, else false
+     */
+    bool startCapture(const char * variables, uint32_t rate, uint16_t postSamples);
+
+    /// @brief stops capturing
+    void stopCapture();
+
+    /// @brief takes one sample (constant time). May be called from control loop or interrupt.
+    void captureSample();
+
+    /// @brief starts counting samples after trigger
+    void triggerCapture();
+#endif // DIAGTASK_ENABLE_CAPTURE
+
 #if DIAGTASK_ENABLE_READ_KEY
     /*!
       * @brief  Reads a character from serial console
@@ -316,6 +1662,93 @@ class DiagTask
     // findes and returns all hooks that start with current value of mCurrentValidInput[]
     void privFilterHooks();
 
+    // copies hook that matches name (or wildcard hook that matches start of name) to entry.
+    // arg is set to argument of wildcard hook. returns false if no hook matches.
+    bool privFindHook(const char * name, const char ** arg, hookEntry_t & entry);
+
+    // calls f(index, name, shared) for all hooks until f returns true. shared is the number
+    // of characters the name has in common with the name of previous hook (0 if unknown).
+    template<typename F>
+    void privForEachHook(F f);
+
+    // copies hook index with its name to entry
+    void privGetHook(uint16_t index, const char * name, hookEntry_t & entry) const;
+
+    // adds hook index to mFilterredHooks if its name matches input. matched is the number
+    // of leading characters of name that are equal to input.
+    void privFilterHook( uint16_t index, const char * name, uint16_t matched
+                       , const char * input, uint16_t lenInput);
+
+    // returns c in lower case if DIAGTASK_ENABLE_IGNORE_CASE is set
+    static char privFold(char c)
+    {
+      #if DIAGTASK_ENABLE_IGNORE_CASE
+      return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+      #else
+      return c;
+      #endif
+    }
+
+    // returns input that is compared with hook names
+    const char * privMatchInput() const
+    {
+      #if DIAGTASK_ENABLE_IGNORE_CASE
+      return mFoldedInput;
+      #else
+      return mCurrentValidInput;
+      #endif
+    }
+
+    // strncmp() of hook names that ignores case if DIAGTASK_ENABLE_IGNORE_CASE is set
+    static int privNameCompare(const char * a, const char * b, size_t n);
+
+    // returns first placeholder of name ("*", or "<" if DIAGTASK_ENABLE_PATTERNS is set) or NULL
+    static const char * privWildcard(const char * name);
+
+    #if DIAGTASK_ENABLE_PATTERNS
+    // matches pattern (part of a hook name starting at a placeholder) against input.
+    // returns -1 if input does not match, else number of placeholders. if bounds is not NULL,
+    // start and end offset in input of each matched word are stored.
+    static int8_t privMatchPattern(const char * pattern, const char * input, uint16_t (*bounds)[2]);
+
+    // calls pattern hook h if input (behind first placeholder) matches. returns false if not.
+    bool privCallPattern(const hookEntry_t & h, const char * input);
+
+    // '\n' for several filterred hooks: calls first pattern hook that matches the line,
+    // else prints usage. returns false if no pattern hook is filterred.
+    bool privProcessPatterns(uint16_t len);
+    #endif // DIAGTASK_ENABLE_PATTERNS
+
+    #if DIAGTASK_ENABLE_ABBREVIATIONS
+    // checks if input abbreviates name: each segment of input (separated by "-._ /:") must be
+    // the start of the same segment of name. returns -1 if not, -2 if input may become an
+    // abbreviation, else the position of '\n' or the argument in input.
+    static int16_t privAbbreviation(const char * name, const char * input);
+    #endif // DIAGTASK_ENABLE_ABBREVIATIONS
+
+    #if DIAGTASK_HOOK_KEY_LEN && !DIAGTASK_NAME_POOL_LEN
+    // updates keys of hooks starting at index from after mHookNames changed
+    void privUpdateKeys(uint16_t from);
+
+    // returns a bit for each of the 16 keys whose first n characters match input
+    static uint32_t privMatchKeys(const hookKeys_t & keys, const char * input, uint8_t n);
+    #endif
+
+    // returns number of leading characters that are equal in a and b
+    static uint8_t privCommonPrefix(const char * a, const char * b);
+
+    #if DIAGTASK_NAME_POOL_LEN
+    // applies name record at offset of mNamePool to name (holding previous name).
+    // returns offset of next record.
+    uint16_t privPoolNext(uint16_t offset, char * name) const;
+
+    // inserts name in sorted order. returns its index or -1 if pool is full.
+    int32_t privPoolInsert(const char * name);
+
+    // removes name of hook index
+    void privPoolRemove(uint16_t index);
+    #endif // DIAGTASK_NAME_POOL_LEN
+
     // returns true if a special function was executed (help,search,...)
     // input should hold current inserted character.
     // privCheckAndProcessSpecialChars() also access mCurrentValidInput
@@ -328,12 +1761,395 @@ class DiagTask
 
     #if DIAGTASK_ENABLE_HELP
       void privHelp();
+
+      // formats help text into buf or writes it to output if buf is NULL.
+      // returns length or size if text does not fit into buf.
+      uint16_t privRenderHelp(char * buf, uint16_t size);
     #endif // DIAGTASK_ENABLE_HELP
 
+    // marks cached help and column width as outdated after hooks changed
+    void privInvalidateHelp();
+
+    #if DIAGTASK_ENABLE_HELP || DIAGTASK_ENABLE_TAB_COMPLETION
+      // returns width of name column (longest hook name)
+      uint8_t privHelpWidth();
+
+      // returns description of hook; buf holds descriptions read via mDescribe
+      const char * privDescription(const hookSlot_t & h, const char * name, char * buf, uint16_t size);
+    #endif
+
     #if DIAGTASK_ENABLE_SEPARATOR
       void  privDisplaySeparator();
     #endif // DIAGTASK_ENABLE_SEPARATOR
 
+    // initializes data that is common to all constructors
+    void privInit();
+
+    // registers built-in commands of enabled features
+    void privRegisterBuiltins();
+
+    // calls hook function of a hook entry
+    void privCallHook(const hookEntry_t & h, const char * input);
+
+    // calls filterred hook; reads a copy of its entry, so the hook may register other hooks
+    void privCallHook(const filterredHook_t & h, const char * input);
+
+    // adds hook entry with name and description to mHooks
+    bool privAddHook(hookEntry_t & entry, const char * name, const char * description);
+
+    #if DIAGTASK_ENABLE_CHUNKED_HOOKS
+    // passes received characters starting with c to active chunked hook
+    void privProcessChunked(int c);
+    #endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+
+    // returns current time stamp of tick source
+    uint32_t privTicks();
+
+    #if DIAGTASK_ENABLE_METRICS
+      // returns shard of calling thread
+      static uint8_t privShard()
+      {
+      #if DIAGTASK_METRIC_SHARDS > 1
+        static std::atomic<uint8_t> next(0);
+        static thread_local uint8_t shard = next.fetch_add(1, std::memory_order_relaxed)
+                                            % DIAGTASK_METRIC_SHARDS;
+        return shard;
+      #else
+        return 0;
+      #endif
+      }
+
+      bool privRegisterMetric(const char * name, void * metric, uint8_t type, const char * description);
+
+      // prints one metric. if snapshot is true, counter prints difference to previous snapshot
+      void privPrintMetric(metricEntry_t & m, bool snapshot);
+
+      // built-in commands: "metrics" and called when user enters name of a metric
+      static void privCmdMetrics(const char * input);
+      static void privCmdMetric(const char * input);
+    #endif // DIAGTASK_ENABLE_METRICS
+
+    #if DIAGTASK_ENABLE_TRACE
+      // adds one event to trace buffer
+      void privTrace(uint8_t type, uintptr_t data, uint16_t arg = 0);
+
+      // address of hook function that identifies a hook in trace events
+      static uintptr_t privHookAddress(const hookSlot_t & h)
+      {
+        #if DIAGTASK_ENABLE_CHUNKED_HOOKS
+        if(h.chunked)
+        { return reinterpret_cast<uintptr_t>(h.chunked); }
+        #endif // DIAGTASK_ENABLE_CHUNKED_HOOKS
+        #if DIAGTASK_ENABLE_PATTERNS
+        if(h.argsHook)
+        { return reinterpret_cast<uintptr_t>(h.argsHook); }
+        #endif // DIAGTASK_ENABLE_PATTERNS
+        return reinterpret_cast<uintptr_t>(h.hook);
+      }
+
+      // prints events of one boot
+      void privDumpTrace(uint32_t boot);
+
+      // built-in command "trace"
+      static void privCmdTrace(const char * input);
+    #endif // DIAGTASK_ENABLE_TRACE
+
+    // returns next space separated argument of input and its length. input is
+    // advanced behind argument. returns 0 if no argument is left.
+    static uint16_t privNextArg(const char *& input, const char *& arg);
+
+    // parses a decimal or hexadecimal ("0x") integer of len characters.
+    // values above INT32_MAX are returned as two's complement.
+    static bool privParseInt(const char * str, uint16_t len, int32_t & out);
+
+    // parses a decimal integer or 64 bit hexadecimal value ("0x"). base 16 parses
+    // hexadecimal values without "0x".
+    static bool privParseNumber(const char * str, uint16_t len, int64_t & out, uint8_t base = 10);
+
+    // argument types requested by privFormat()
+    enum argKind_t
+    {
+      arg_Int,
+      arg_Long,
+      arg_LongLong,
+      arg_Double,     // raw value is bit pattern of double
+      arg_Pointer
+    };
+
+    // formatter used by format(), print() and log. next(kind) returns raw value of next argument.
+    template<typename Next>
+    static uint16_t privFormat(char * buf, uint16_t size, const char * fmt, Next next);
+
+    // reads next argument of kind from ap
+    static uint64_t privVaArg(va_list & ap, uint8_t kind);
+
+    // formats value in base 8, 10 or 16
+    static uint8_t privFormatInteger(char * buf, uint64_t value, uint8_t base, bool upper);
+
+    // fast number formatting without printf(). returns number of characters written
+    // (without '\0'). buffer must hold at least 12 (integer) or 20 (float) characters.
+    static uint8_t privFormatUnsigned(char * buf, uint32_t value);
+    static uint8_t privFormatSigned(char * buf, int32_t value);
+    static uint8_t privFormatFloat(char * buf, float value, uint8_t digits);
+
+    // formats value like printf() conversion 'f', 'e' or 'g' (upper case allowed) with
+    // up to 17 digits. buffer must hold at least 40 characters
+    static uint8_t privFormatDouble(char * buf, double value, uint8_t digits, char conversion);
+
+    #if DIAGTASK_ENABLE_VARIABLES
+      static uint8_t privVarType(bool *)     { return var_Bool; }
+      static uint8_t privVarType(uint8_t *)  { return var_U8; }
+      static uint8_t privVarType(int8_t *)   { return var_I8; }
+      static uint8_t privVarType(uint16_t *) { return var_U16; }
+      static uint8_t privVarType(int16_t *)  { return var_I16; }
+      static uint8_t privVarType(uint32_t *) { return var_U32; }
+      static uint8_t privVarType(int32_t *)  { return var_I32; }
+      static uint8_t privVarType(float *)    { return var_Float; }
+
+      bool privRegisterVariable(const char * name, void * variable, uint8_t type,
+                                uint8_t flags, int32_t min, int32_t max);
+
+      // returns variable with name of len characters or NULL
+      varEntry_t * privFindVariable(const char * name, uint16_t len);
+
+      // formats value of variable. returns number of characters
+      static uint8_t privFormatVariable(char * buf, const varEntry_t & v);
+
+      // parses value and writes it to variable. returns NULL on success or error message
+      static const char * privWriteVariable(const varEntry_t & v, const char * value, uint16_t len);
+
+      // returns value of variable as raw 32 bit value
+      static uint32_t privReadVariable(const varEntry_t & v);
+
+      // converts space separated list of variable names into indices. returns number of
+      // variables or 0 on error
+      uint8_t privSelectVariables(const char * names, uint8_t * vars, uint8_t max);
+
+      // writes type and name of variables into desc. returns number of bytes
+      uint16_t privDescribeVariables(const uint8_t * vars, uint8_t count, uint8_t * desc);
+
+      // converts samples per second into ticks. fails if rate exceeds resolution of tick
+      // source or if there is no tick source
+      bool privSamplePeriod(uint32_t rate, uint32_t & period);
+
+      // built-in commands "get", "set" and "vars"
+      static void privCmdGet(const char * input);
+      static void privCmdSet(const char * input);
+      static void privCmdVars(const char * input);
+    #endif // DIAGTASK_ENABLE_VARIABLES
+
+    #if DIAGTASK_ENABLE_STREAM
+      // copies a frame into stream buffer
+      bool privStreamFrame(uint8_t type, const uint8_t * payload, uint8_t len);
+
+      // writes stream buffer to output
+      void privFlushStream();
+
+      // built-in command "stream"
+      static void privCmdStream(const char * input);
+    #endif // DIAGTASK_ENABLE_STREAM
+
+    #if DIAGTASK_ENABLE_CAPTURE
+      // writes frozen capture buffer as binary frames
+      void privDumpCapture();
+
+      // built-in command "cap"
+      static void privCmdCapture(const char * input);
+    #endif // DIAGTASK_ENABLE_CAPTURE
+
+    #if DIAGTASK_ENABLE_MEMORY
+      // parses "<addr> <len>" and starts job
+      bool privStartMemoryJob(const char * input, bool (DiagTask::*step)());
+
+      // job steps of "md" and "mdb"
+      bool privJobHexDump();
+      bool privJobBinaryDump();
+
+      // formats one row of hex dump (up to 16 bytes). returns number of characters
+      static uint8_t privFormatHexRow(char * buf, const uint8_t * addr, uint8_t len);
+
+      // job steps of "find", "crc" and "sum"
+      bool privJobFind();
+      bool privJobCrc();
+      bool privJobSum();
+
+      // built-in commands "md", "mdb", "find", "crc" and "sum"
+      static void privCmdHexDump(const char * input);
+      static void privCmdBinaryDump(const char * input);
+      static void privCmdFind(const char * input);
+      static void privCmdCrc(const char * input);
+      static void privCmdSum(const char * input);
+    #endif // DIAGTASK_ENABLE_MEMORY
+
+    // returns true if a periodic action is due and calculates next time
+    bool privDue(uint32_t & next, uint32_t period);
+
+    // writes one binary frame: sync, length, sequence, type, payload, crc8
+    void privWriteFrame(uint8_t seq, uint8_t type, const void * payload, uint8_t len)
+    { privWriteFrame(seq, type, payload, len, NULL, 0); }
+
+    // writes one binary frame with payload from two buffers (header and data without copy)
+    void privWriteFrame( uint8_t seq, uint8_t type, const void * header, uint8_t headerLen
+                       , const void * data, uint8_t len);
+
+    #if DIAGTASK_ENABLE_TRIGGERS
+      // compiles condition of len characters into code. returns length of code or 0
+      uint8_t privCompileTrigger(const char * condition, uint16_t len, uint8_t * code);
+
+      // recursive descent parser; level is the operator precedence
+      void privParseExpr(triggerParser_t & p, uint8_t level);
+      void privParseUnary(triggerParser_t & p);
+      void privEmit(triggerParser_t & p, uint8_t op, int8_t stack, const void * arg = NULL, uint8_t len = 0);
+
+      // returns result of compiled condition
+      int32_t privEvaluate(const uint8_t * code);
+
+      // built-in command "trig"
+      static void privCmdTrigger(const char * input);
+    #endif // DIAGTASK_ENABLE_TRIGGERS
+
+    #if DIAGTASK_ENABLE_MACROS
+      // returns index of macro with name or -1
+      int8_t privFindMacro(const char * name);
+
+      // removes steps of macro at index; steps of following macros move down
+      void privRemoveMacroSteps(uint8_t index);
+
+      // appends input to argument of step, separated by ' '
+      static void privAppendArgument(macroStep_t & step, const char * input);
+
+      // calls steps of macro; input of an alias is appended to argument of its step
+      void privRunMacro(uint8_t index, const char * input);
+
+      // built-in commands "alias" and "macro"
+      static void privCmdMacro(const char * input);
+    #endif // DIAGTASK_ENABLE_MACROS
+
+    #if DIAGTASK_ENABLE_UPLOAD
+      // reads received bytes until one upload block is complete
+      void privProcessUpload();
+
+      // handles complete block in mUploadBlock
+      void privUploadBlock();
+
+      // sends acknowledge frame with status and mUploadOffset
+      void privUploadAck(uint8_t status);
+
+      // ends upload and calls close() of sink
+      void privUploadEnd(bool complete);
+
+      // built-in command "recv"
+      static void privCmdRecv(const char * input);
+    #endif // DIAGTASK_ENABLE_UPLOAD
+
+    #if DIAGTASK_ENABLE_DOWNLOAD
+      // returns number of contiguous bytes at offset of download (max. len) and their address
+      uint32_t privDownloadSegment(uint32_t offset, uint32_t len, const uint8_t *& p);
+
+      // job step that sends download
+      bool privJobDownload();
+
+      // built-in command "dl"
+      static void privCmdDownload(const char * input);
+    #endif // DIAGTASK_ENABLE_DOWNLOAD
+
+    // crc-8 (polynomial 0x07) used to protect frames
+    static uint8_t privCrc8(uint8_t crc, const uint8_t * data, uint16_t len);
+
+    #if DIAGTASK_ENABLE_MEMORY || DIAGTASK_ENABLE_UPLOAD || DIAGTASK_ENABLE_DOWNLOAD
+    // crc-32 (ISO-HDLC, polynomial 0xEDB88320) of data; crc is result of previous call or 0
+    static uint32_t privCrc32(uint32_t crc, const uint8_t * data, uint32_t len);
+    #endif // DIAGTASK_ENABLE_MEMORY || DIAGTASK_ENABLE_UPLOAD || DIAGTASK_ENABLE_DOWNLOAD
+
+    #if DIAGTASK_ENABLE_COMPRESSION
+      // compresses data into groups of tokens
+      void privCompress(const uint8_t * data, uint16_t len);
+
+      // adds literal or match to current group. group is written when it is complete.
+      void privZipToken(bool match, uint16_t value);
+
+      // adds control token (flush, end) and writes incomplete group
+      void privZipControl(uint8_t code);
+
+      // built-in command "compress"
+      static void privCmdCompress(const char * input);
+    #endif // DIAGTASK_ENABLE_COMPRESSION
+
+    #if DIAGTASK_ENABLE_SINKS
+      // writes pending output of all sinks as far as rate and sinks allow
+      void privDrainSinks();
+
+      // built-in command "sinks"
+      static void privCmdSinks(const char * input);
+    #endif // DIAGTASK_ENABLE_SINKS
+
+    #if DIAGTASK_ENABLE_SINKS || DIAGTASK_ENABLE_BUDGETS
+      // initializes bucket; burst 0 means rate
+      void privInitBucket(tokenBucket_t & bucket, uint32_t rate, uint32_t burst);
+
+      // adds tokens for time since last call and returns available bytes (max. len)
+      uint32_t privTake(tokenBucket_t & bucket, uint32_t len);
+    #endif // DIAGTASK_ENABLE_SINKS || DIAGTASK_ENABLE_BUDGETS
+
+    #if DIAGTASK_ENABLE_BUDGETS
+      // returns number of bytes of len that fit into budgets and takes them
+      uint16_t privBudget(uint16_t len);
+    #endif // DIAGTASK_ENABLE_BUDGETS
+
+    // sets hook that is currently called (NULL after call)
+    void privSetCurrentHook(const hookEntry_t * hook);
+
+    // writes data compressed or uncompressed
+    void privWriteOutput(const char* data, uint16_t len);
+
+    // writes data to output function (or sinks) without compression
+    void privWriteRaw(const char* data, uint16_t len);
+
+    // all output of diagtask goes through these functions
+    void privWrite(const char* data, uint16_t len);
+    void privPrintf(const char* fmt, ...)
+    #ifdef __GNUC__
+      __attribute__((format(printf, 2, 3)))
+    #endif
+      ;
+    void privVPrintf(const char* fmt, va_list ap);
+
+    #if DIAGTASK_ENABLE_LOG
+      // converts a log argument into its raw 64 bit representation
+      template<typename T>
+      static uint64_t privLogArg(T * value)
+      { return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)); }
+
+      template<typename T>
+      static uint64_t privLogArg(T value)
+      { return privLogArg(value, std::is_floating_point<T>()); }
+
+      template<typename T>
+      static uint64_t privLogArg(T value, std::true_type)
+      {
+        double d = value;
+        uint64_t raw;
+        memcpy(&raw, &d, sizeof(raw));
+        return raw;
+      }
+
+      template<typename T>
+      static uint64_t privLogArg(T value, std::false_type)
+      { return static_cast<uint64_t>(static_cast<int64_t>(value)); }
+
+      bool privLog(const logModule_t * module, uint8_t level,
+                   const char * fmt, const uint64_t * args, uint8_t count);
+
+      // built-in command "log-level"
+      static void privCmdLogLevel(const char * input);
+
+      // formats up to DIAGTASK_LOG_DRAIN_PER_PROCESS log entries
+      void privDrainLog();
+
+      // formats one log entry into buf
+      uint16_t privFormatLog(char * buf, uint16_t size, const logEntry_t & entry);
+    #endif // DIAGTASK_ENABLE_LOG
+
   /// @endcond
 }; // class diagtask
 
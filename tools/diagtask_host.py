@@ -0,0 +1,514 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2021, Stephan Enderlein. All rights reserved.
+# SPDX-License-Identifier: BSD-3-Clause
+#
+"""Host side tools for diagtask.
+
+  stream   decodes binary samples sent by "stream" (DIAGTASK_ENABLE_STREAM) or
+           "cap dump" (DIAGTASK_ENABLE_CAPTURE) and prints them as CSV.
+           Console text between frames is written to stderr.
+  memory   writes data sent by "mdb" (DIAGTASK_ENABLE_MEMORY) to a binary file.
+  upload   sends a file with "recv" (DIAGTASK_ENABLE_UPLOAD) to the sink of the device.
+  download receives memory, trace or capture buffer with "dl" (DIAGTASK_ENABLE_DOWNLOAD)
+           and resumes after lost frames.
+  decompress restores output compressed by "compress on" (DIAGTASK_ENABLE_COMPRESSION)
+           and writes it to stdout, e.g. to pipe it into "stream -".
+
+Input is read from a file, a serial device (already configured, e.g. via stty)
+or stdin ("-"). upload and download need a device that can be read and written
+(a tty is switched to raw mode).
+"""
+
+import argparse
+import os
+import select
+import struct
+import sys
+import termios
+import time
+import tty
+import zlib
+
+FRAME_SYNC = 0xA5
+
+STREAM_FRAME_KEY = 0
+STREAM_FRAME_DELTA = 1
+STREAM_FRAME_DESCRIPTION = 2
+STREAM_FRAME_CAPTURE = 3
+STREAM_FRAME_MEMORY = 4
+STREAM_FRAME_UPLOAD = 5
+STREAM_FRAME_UPLOAD_END = 6
+STREAM_FRAME_UPLOAD_ACK = 7
+STREAM_FRAME_DOWNLOAD = 8
+STREAM_FRAME_DOWNLOAD_END = 9
+STREAM_FRAME_COMPRESS = 10
+
+# status of STREAM_FRAME_UPLOAD_ACK (uploadStatus_t)
+UPLOAD_READY = 0
+UPLOAD_ACK = 1
+UPLOAD_NAK = 2
+UPLOAD_DONE = 3
+UPLOAD_FAILED = 4
+
+# variable types of diagtask (varType_t): struct format, signed
+VAR_TYPES = [
+    ('B', False),  # bool
+    ('B', False),  # u8
+    ('b', True),   # i8
+    ('H', False),  # u16
+    ('h', True),   # i16
+    ('I', False),  # u32
+    ('i', True),   # i32
+    ('f', False),  # float
+]
+VAR_FLOAT = 7
+
+
+def crc8(data, crc=0):
+    """crc-8, polynomial 0x07 (same as DiagTask::privCrc8())"""
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+class FrameParser:
+    """splits received bytes into frames and console text"""
+
+    def __init__(self, text):
+        self.buf = bytearray()
+        self.text = text
+
+    def feed(self, chunk):
+        """returns list of (seq, type, payload) of all complete frames. other bytes are passed to text()"""
+        frames = []
+        buf = self.buf
+        buf += chunk
+        pos = 0
+        while pos < len(buf):
+            if buf[pos] != FRAME_SYNC:
+                end = buf.find(bytes([FRAME_SYNC]), pos)
+                end = len(buf) if end < 0 else end
+                self.text(bytes(buf[pos:end]))
+                pos = end
+                continue
+            if len(buf) - pos < 4:
+                break
+            size = buf[pos + 1] + 5
+            if len(buf) - pos < size:
+                break
+            frame = buf[pos:pos + size]
+            if crc8(frame[1:-1]) != frame[-1]:
+                # no valid frame; skip sync byte
+                self.text(bytes(buf[pos:pos + 1]))
+                pos += 1
+                continue
+            frames.append((frame[2], frame[3], bytes(frame[4:-1])))
+            pos += size
+        del buf[:pos]
+        return frames
+
+
+def read_frames(stream, text):
+    """yields (seq, type, payload) of all valid frames. other bytes are passed to text()"""
+    parser = FrameParser(text)
+    while True:
+        chunk = stream.read(4096)
+        if not chunk:
+            break
+        for frame in parser.feed(chunk):
+            yield frame
+
+
+def write_text(data):
+    sys.stderr.write(data.decode('ascii', 'replace'))
+
+
+class Decompressor:
+    """restores output of DiagTask::privCompress(). raw output is passed unchanged."""
+
+    ZIP_FLUSH = 0
+    ZIP_END = 1
+
+    def __init__(self):
+        self.compressed = False
+        self.raw = bytearray()      # raw bytes that may be start of compress frame
+        self.window = bytearray()
+        self.flags = 0
+        self.tokens = 0             # remaining tokens of group
+        self.high = None            # first byte of match
+
+    def start_frame(self, bits):
+        frame = bytes([1, 0, STREAM_FRAME_COMPRESS, bits])
+        return bytes([FRAME_SYNC]) + frame + bytes([crc8(frame)])
+
+    def feed(self, data):
+        out = bytearray()
+        for b in data:
+            if not self.compressed:
+                self.raw.append(b)
+                if b == FRAME_SYNC and len(self.raw) > 1:
+                    out += self.raw[:-1]
+                    del self.raw[:-1]
+                if self.raw[0] != FRAME_SYNC or len(self.raw) == 6:
+                    if len(self.raw) == 6 and self.raw == self.start_frame(self.raw[4]):
+                        self.compressed = True
+                        self.len_bits = 16 - self.raw[4]
+                        self.window_size = 1 << self.raw[4]
+                        self.window = bytearray()
+                        self.tokens = 0
+                    else:
+                        out += self.raw
+                    self.raw = bytearray()
+                continue
+
+            if not self.tokens:
+                self.flags = b
+                self.tokens = 8
+                continue
+
+            if not self.flags & 1:
+                out.append(b)
+                self.window.append(b)
+            elif self.high is None:
+                self.high = b
+                continue
+            else:
+                value = self.high << 8 | b
+                self.high = None
+                dist = (value >> self.len_bits) + 1
+                code = value & ((1 << self.len_bits) - 1)
+                if not code:
+                    self.tokens = 0
+                    if dist - 1 == self.ZIP_END:
+                        self.compressed = False
+                    continue
+                for _ in range(code + 2):
+                    c = self.window[-dist]
+                    out.append(c)
+                    self.window.append(c)
+            self.flags >>= 1
+            self.tokens -= 1
+            if len(self.window) > 2 * self.window_size:
+                del self.window[:-self.window_size]
+        return bytes(out)
+
+    def flush(self):
+        """returns raw bytes kept while waiting for a complete frame"""
+        out = bytes(self.raw)
+        self.raw = bytearray()
+        return out
+
+
+def decode_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        b = data[pos]
+        pos += 1
+        value |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return value, pos
+
+
+def to_value(vtype, raw):
+    """converts raw 32 bit value of diagtask into python value"""
+    fmt, signed = VAR_TYPES[vtype]
+    if vtype == VAR_FLOAT:
+        return struct.unpack('<f', struct.pack('<I', raw))[0]
+    size = struct.calcsize(fmt)
+    raw &= (1 << (8 * size)) - 1
+    if signed and raw & (1 << (8 * size - 1)):
+        raw -= 1 << (8 * size)
+    return raw
+
+
+def cmd_stream(args):
+    variables = None    # list of (type, name)
+    prev = None
+    expected = None
+    capture = None      # [trigger position, period in seconds, sample index]
+    out = sys.stdout
+
+    for seq, ftype, payload in read_frames(args.input, write_text):
+        if ftype == STREAM_FRAME_DESCRIPTION:
+            desc = []
+            pos = 0
+            while pos < len(payload):
+                end = payload.index(0, pos + 1)
+                desc.append((payload[pos], payload[pos + 1:end].decode('ascii')))
+                pos = end + 1
+            if desc != variables or capture:
+                variables = desc
+                prev = None
+                capture = None
+                out.write('seq,' + ','.join(name for _, name in variables) + '\n')
+            continue
+
+        if ftype == STREAM_FRAME_CAPTURE:
+            # capture dump: first column is time relative to trigger
+            count, trigger, period, rate = struct.unpack('<HHII', payload)
+            capture = [trigger, period / float(rate), 0]
+            expected = None
+            out.write('# capture: %d samples, trigger at sample %d\n' % (count, trigger))
+            out.write('time,' + ','.join(name for _, name in variables) + '\n')
+            continue
+
+        if variables is None:
+            continue
+
+        if expected is not None and seq != expected:
+            sys.stderr.write('missing samples %d..%d\n' % (expected, (seq - 1) & 0xFF))
+            prev = None
+        expected = (seq + 1) & 0xFF
+
+        values = []
+        pos = 0
+        for i, (vtype, _) in enumerate(variables):
+            if ftype == STREAM_FRAME_DELTA and vtype != VAR_FLOAT:
+                if prev is None:
+                    values = None
+                    break
+                zigzag, pos = decode_varint(payload, pos)
+                diff = (zigzag >> 1) ^ -(zigzag & 1)
+                values.append((prev[i] + diff) & 0xFFFFFFFF)
+            else:
+                fmt, signed = VAR_TYPES[vtype]
+                size = struct.calcsize(fmt)
+                raw = struct.unpack_from('<' + fmt, payload, pos)[0]
+                pos += size
+                if vtype == VAR_FLOAT:
+                    raw = struct.unpack('<I', struct.pack('<f', raw))[0]
+                values.append(raw & 0xFFFFFFFF)
+
+        if values is None:
+            # delta frame without previous complete sample
+            continue
+
+        prev = values
+        if capture:
+            seq = '%g' % ((capture[2] - capture[0]) * capture[1])
+            capture[2] += 1
+        out.write('%s,' % seq + ','.join(str(to_value(t, v)) for (t, _), v in zip(variables, values)) + '\n')
+        out.flush()
+
+
+def cmd_memory(args):
+    blocks = {}
+    for _, ftype, payload in read_frames(args.input, write_text):
+        if ftype == STREAM_FRAME_MEMORY:
+            addr = struct.unpack_from('<Q', payload)[0]
+            blocks[addr] = payload[8:]
+
+    if not blocks:
+        sys.exit('no memory frames received')
+
+    start = min(blocks)
+    end = max(addr + len(data) for addr, data in blocks.items())
+    image = bytearray(end - start)
+    for addr, data in blocks.items():
+        image[addr - start:addr - start + len(data)] = data
+    args.output.write(image)
+    sys.stderr.write('0x%x..0x%x (%d bytes)\n' % (start, end, end - start))
+
+
+def upload_block(seq, ftype, payload):
+    """upload blocks are protected by crc-32 instead of crc-8"""
+    header = bytes([len(payload), seq & 0xFF, ftype])
+    return bytes([FRAME_SYNC]) + header + payload + struct.pack('<I', zlib.crc32(header + payload))
+
+
+def open_device(path):
+    """opens device for reading and writing; returns fd and previous tty attributes"""
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    attr = None
+    if os.isatty(fd):
+        attr = termios.tcgetattr(fd)
+        tty.setraw(fd)
+    return fd, attr
+
+
+def close_device(fd, attr):
+    if attr:
+        termios.tcsetattr(fd, termios.TCSADRAIN, attr)
+    os.close(fd)
+
+
+def cmd_upload(args):
+    data = args.file.read()
+    name = args.name or os.path.basename(args.file.name)
+    fd, attr = open_device(args.device)
+    parser = FrameParser(write_text)
+
+    def receive(timeout):
+        """returns payloads of acknowledge frames received within timeout"""
+        acks = []
+        end = time.monotonic() + timeout
+        while not acks:
+            remaining = end - time.monotonic()
+            if remaining <= 0 or not select.select([fd], [], [], remaining)[0]:
+                break
+            for _, ftype, payload in parser.feed(os.read(fd, 4096)):
+                if ftype == STREAM_FRAME_UPLOAD_ACK and len(payload) == 5:
+                    acks.append(struct.unpack('<BI', payload))
+        return acks
+
+    try:
+        os.write(fd, b'recv %s\r' % name.encode('ascii'))
+        acks = receive(args.timeout)
+        if not acks or acks[0][0] != UPLOAD_READY:
+            sys.exit('device did not accept upload')
+        size = min(args.block, acks[0][1])
+
+        # last block is end frame with size and crc-32 of file
+        blocks = [data[i:i + size] for i in range(0, len(data), size)]
+        count = len(blocks)
+        base = 0        # first block that is not acknowledged
+        sent = 0        # next block to send
+        retries = 0
+        while True:
+            while sent < base + args.window and sent <= count:
+                if sent < count:
+                    os.write(fd, upload_block(sent, STREAM_FRAME_UPLOAD, blocks[sent]))
+                else:
+                    os.write(fd, upload_block(sent, STREAM_FRAME_UPLOAD_END,
+                                              struct.pack('<II', len(data), zlib.crc32(data))))
+                sent += 1
+
+            acks = receive(args.timeout)
+            if not acks:
+                retries += 1
+                if retries > args.retries:
+                    os.write(fd, upload_block(0, STREAM_FRAME_UPLOAD_END, b''))
+                    sys.exit('no response from device')
+                sent = base
+                continue
+            retries = 0
+
+            for status, offset in acks:
+                if status == UPLOAD_DONE:
+                    sys.stderr.write('%d bytes sent\n' % len(data))
+                    return
+                if status == UPLOAD_FAILED:
+                    sys.exit('upload failed at offset %d' % offset)
+                # offset is multiple of block size except at end of file
+                base = max(base, (offset + size - 1) // size)
+                if status == UPLOAD_NAK:
+                    # go back n
+                    sent = base
+    finally:
+        close_device(fd, attr)
+
+
+def cmd_download(args):
+    fd, attr = open_device(args.device)
+    parser = FrameParser(write_text)
+    image = bytearray()
+    resumed = None      # offset of last resume request
+    retries = 0
+
+    def resume():
+        nonlocal resumed
+        if resumed != len(image):
+            resumed = len(image)
+            os.write(fd, b'dl resume %d\r' % resumed)
+
+    try:
+        os.write(fd, b'dl %s\r' % ' '.join(args.source).encode('ascii'))
+        while True:
+            if not select.select([fd], [], [], args.timeout)[0]:
+                retries += 1
+                if retries > args.retries:
+                    sys.exit('no response from device')
+                resumed = None
+                resume()
+                continue
+
+            for _, ftype, payload in parser.feed(os.read(fd, 65536)):
+                if ftype == STREAM_FRAME_DOWNLOAD:
+                    retries = 0
+                    offset = struct.unpack_from('<I', payload)[0]
+                    if offset == len(image):
+                        image += payload[4:]
+                        resumed = None
+                    elif offset > len(image):
+                        # frame lost or damaged
+                        resume()
+                elif ftype == STREAM_FRAME_DOWNLOAD_END:
+                    size, crc = struct.unpack('<II', payload)
+                    if len(image) < size:
+                        resume()
+                    elif zlib.crc32(image) == crc:
+                        args.output.write(image)
+                        sys.stderr.write('%d bytes received\n' % size)
+                        return
+                    else:
+                        # damage that was not detected by crc-8; receive again
+                        retries += 1
+                        if retries > args.retries:
+                            sys.exit('crc mismatch')
+                        del image[:]
+                        resumed = None
+                        resume()
+    finally:
+        close_device(fd, attr)
+
+
+def cmd_decompress(args):
+    decoder = Decompressor()
+    out = sys.stdout.buffer
+    while True:
+        chunk = args.input.read(4096)
+        if not chunk:
+            break
+        out.write(decoder.feed(chunk))
+        out.flush()
+    out.write(decoder.flush())
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    p = sub.add_parser('stream', help='decode binary variable stream to CSV')
+    p.add_argument('input', help='file or device to read from, "-" for stdin')
+    p.set_defaults(func=cmd_stream)
+
+    p = sub.add_parser('memory', help='write memory dump of "mdb" to file')
+    p.add_argument('input', help='file or device to read from, "-" for stdin')
+    p.add_argument('output', type=argparse.FileType('wb'), help='binary output file')
+    p.set_defaults(func=cmd_memory)
+
+    p = sub.add_parser('decompress', help='restore compressed output and write it to stdout')
+    p.add_argument('input', help='file or device to read from, "-" for stdin')
+    p.set_defaults(func=cmd_decompress)
+
+    p = sub.add_parser('upload', help='send file to sink of device ("recv")')
+    p.add_argument('device', help='serial device or pty of device')
+    p.add_argument('file', type=argparse.FileType('rb'), help='file to send')
+    p.add_argument('--name', help='name passed to sink (default: file name)')
+    p.add_argument('--block', type=int, default=255, help='maximal block length (device may limit it)')
+    p.add_argument('--window', type=int, default=8, help='number of blocks sent without acknowledge')
+    p.add_argument('--timeout', type=float, default=1.0, help='seconds to wait for acknowledge')
+    p.add_argument('--retries', type=int, default=5, help='number of timeouts until upload is cancelled')
+    p.set_defaults(func=cmd_upload)
+
+    p = sub.add_parser('download', help='receive memory ("dl <addr> <len>"), trace or capture buffer')
+    p.add_argument('device', help='serial device or pty of device')
+    p.add_argument('output', type=argparse.FileType('wb'), help='binary output file')
+    p.add_argument('source', nargs='+', help='arguments of "dl": <hex addr> <len>, trace or cap')
+    p.add_argument('--timeout', type=float, default=1.0, help='seconds to wait for data')
+    p.add_argument('--retries', type=int, default=5, help='number of timeouts until download is cancelled')
+    p.set_defaults(func=cmd_download)
+
+    args = parser.parse_args()
+    if hasattr(args, 'input'):
+        args.input = sys.stdin.buffer if args.input == '-' else open(args.input, 'rb', buffering=0)
+    args.func(args)
+
+
+if __name__ == '__main__':
+    main()